@@ -9,6 +9,13 @@ CONFIG += c++17
 #QMAKE_CFLAGS += -Wshorten-64-to-32
 QMAKE_CXXFLAGS += -Wshorten-64-to-32
 
+# vector backend of poly/vec3.hpp: sse2 on x86_64, avx2 with -mavx2,
+# scalar elsewhere or forced with VEC3_SCALAR. the batched face kernels of
+# poly/face_kernels.hpp run on avx2 + fma cpus in any x86 gcc / clang
+# build (dispatched at run time), inlined with -mavx2 -mfma
+#QMAKE_CXXFLAGS += -mavx2 -mfma
+#DEFINES += VEC3_SCALAR
+
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
 # depend on your compiler). Please consult the documentation of the
@@ -38,14 +45,23 @@ HEADERS += \
     mainwindow.h \
     mesh.h \
     poly/Thread.h \
+    poly/admission.hpp \
+    poly/area_classes.hpp \
+    poly/canonical.hpp \
     poly/color.hpp \
+    poly/counts.hpp \
     poly/common.hpp \
+    poly/face_kernels.hpp \
     poly/fastflags.h \
+    poly/goldberg.hpp \
+    poly/halfedges.hpp \
     poly/johnson.hpp \
+    poly/parse_cache.hpp \
     poly/parser.hpp \
     poly/poly_operations_mt.hpp \
     poly/polyhedron.hpp \
     poly/seeds.hpp \
+    poly/vec3.hpp \
     renderer.h
 
 FORMS += \
@@ -0,0 +1,831 @@
+//
+//  bench.cpp
+//  Polyhedronisme
+//
+//  benchmarks of the poly/ engine, each with its regression checks (a
+//  result against its reference implementation or invariant). runs all, or
+//  the ones named: bench compile cache. exit status 1 on a failed check
+//
+
+#include "parser.hpp"
+#include <set>
+#ifdef __APPLE__
+#include <simd/simd.h> // test_vec_performance reference
+#endif
+
+static int failures = 0;
+
+// counts a failed check, its word for the log
+static const char *check(bool ok, const char *pass = "same",
+                         const char *fail = "DIFFERENT") {
+  failures += !ok;
+  return ok ? pass : fail;
+}
+
+// each point of one set has one of the other in its cell of a 1e-4 grid
+// or a neighbor cell
+static bool same_points(Polyhedron &a, Polyhedron &b) {
+  using Point = std::tuple<long, long, long>;
+  auto grid = [](const Vertex &v, int dx, int dy, int dz) -> Point {
+    return {lrintf(v.x * 1e4f) + dx, lrintf(v.y * 1e4f) + dy,
+            lrintf(v.z * 1e4f) + dz};
+  };
+  auto in = [&grid](Polyhedron &a, Polyhedron &b) {
+    std::set<Point> ps;
+    for (auto &v : b.vertexes)
+      ps.insert(grid(v, 0, 0, 0));
+    for (auto &v : a.vertexes) {
+      bool found = false;
+      for (int i = 0; i < 27 && !found; i++)
+        found = ps.count(grid(v, i % 3 - 1, i / 3 % 3 - 1, i / 9 - 1));
+      if (!found)
+        return false;
+    }
+    return true;
+  };
+  return in(a, b) && in(b, a);
+}
+
+// same vertexes (a 1e-4 grid, as same_points) and the same faces as
+// oriented cycles, in any order: mirror images differ
+static bool same_shape(Polyhedron &a, Polyhedron &b) {
+  if (a.n_vertex != b.n_vertex || a.n_faces != b.n_faces)
+    return false;
+  using Point = std::tuple<long, long, long>;
+  auto grid = [](const Vertex &v, int dx, int dy, int dz) -> Point {
+    return {lrintf(v.x * 1e4f) + dx, lrintf(v.y * 1e4f) + dy,
+            lrintf(v.z * 1e4f) + dz};
+  };
+  std::map<Point, int> ib; // vertex of b in a cell
+  for (size_t i = 0; i < b.vertexes.size(); i++)
+    ib[grid(b.vertexes[i], 0, 0, 0)] = i;
+  vector<int> to(a.vertexes.size(), -1); // vertex of a -> of b
+  for (size_t i = 0; i < a.vertexes.size(); i++)
+    for (int c = 0; c < 27 && to[i] == -1; c++) {
+      auto it = ib.find(grid(a.vertexes[i], c % 3 - 1, c / 3 % 3 - 1,
+                             c / 9 - 1));
+      if (it != ib.end())
+        to[i] = it->second;
+    }
+
+  auto cycles = [](Polyhedron &p, const vector<int> *to) {
+    vector<vector<int>> fs;
+    for (size_t f = 0; f < p.n_faces; f++) {
+      vector<int> c;
+      for (auto v : p.faces[f])
+        c.push_back(to ? (*to)[v] : v);
+      std::rotate(c.begin(), std::min_element(c.begin(), c.end()),
+                  c.end());
+      fs.push_back(c);
+    }
+    std::sort(fs.begin(), fs.end());
+    return fs;
+  };
+  return std::find(to.begin(), to.end(), -1) == to.end() &&
+         cycles(a, &to) == cycles(b, nullptr);
+}
+
+static bool same(Polyhedron &a, Polyhedron &b) { // vertexes & faces
+  if (a.vertexes.size() != b.vertexes.size() ||
+      a.faces.offsets != b.faces.offsets ||
+      a.faces.indexes != b.faces.indexes)
+    return false;
+  for (size_t i = 0; i < a.vertexes.size(); i++)
+    if (a.vertexes[i].x != b.vertexes[i].x ||
+        a.vertexes[i].y != b.vertexes[i].y ||
+        a.vertexes[i].z != b.vertexes[i].z)
+      return false;
+  return true;
+}
+
+static void test_tuple_performance() {
+
+  int n = 2e6;
+  vector<Int4> _v4;
+  vector<Int4> v4;
+  Int4 i0, i1(1), i2(1, 2), i3(1, 2, 3), i4(1, 2, 3, 4);
+
+  Timer t;
+
+  _v4.resize(n);
+  t.timer("_Int4 init");
+  v4.resize(n);
+  t.timer("Int4 init");
+
+  for (int i = 0; i < n; i++)
+    _v4[i] = Int4(rand(), rand(), rand(), rand());
+  t.timer("_Int4 fill");
+  for (int i = 0; i < n; i++)
+    v4[i] = Int4(rand(), rand(), rand(), rand());
+  t.timer("Int4 fill");
+
+  sort(_v4.begin(), _v4.end());
+  t.timer("sort _Int4");
+
+  sort(v4.begin(), v4.end());
+  t.timer("sort Int4");
+
+  printf("is sorted _v4:%d, v4:%d\n", std::is_sorted(_v4.begin(), _v4.end()),
+         std::is_sorted(v4.begin(), v4.end()));
+}
+
+// per dispatch overhead: spawn & join nth threads (old scheme) vs pool, and
+// the pool dispatches per notation on small seeds
+static void test_dispatch_performance(int n = 1000) {
+  using clock = std::chrono::high_resolution_clock;
+  auto usecs = [](clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(clock::now() - t0)
+        .count();
+  };
+  int nth = Thread::getnthreads(), m = 10 * n;
+  std::atomic<int> sink{0};
+
+  auto t0 = clock::now();
+  for (int i = 0; i < m; i++) {
+    std::vector<thread> threads;
+    for (int t = 0; t < nth; t++)
+      threads.emplace_back([&sink] { sink++; });
+    for (auto &th : threads)
+      th.join();
+  }
+  double spawn = usecs(t0) / m;
+
+  t0 = clock::now();
+  for (int i = 0; i < m; i++)
+    Thread(nth).run([&sink](int) { sink++; });
+  double pool = usecs(t0) / m;
+
+  printf("dispatch x%d threads: spawn %.2fus, pool %.2fus (%d)\n", nth,
+         spawn, pool, int(sink));
+
+  Parser::use_cache = false;
+
+  for (auto s : {"T", "C", "kT", "aC", "qqT", "kkC", "dakC"}) {
+    auto &pool = ThreadPool::instance();
+    long d0 = pool.dispatches();
+    auto t0 = clock::now();
+    for (int i = 0; i < n; i++)
+      Parser::parse(s);
+    printf("%-5s: %.1fus/parse, %ld dispatches/parse\n", s, usecs(t0) / n,
+           (pool.dispatches() - d0) / n);
+  }
+  Parser::use_cache = true;
+}
+
+// sort_unique_v: radix vs std::sort on the keys emitted by ambo, gyro and
+// quinto
+static void test_sort_performance(string base = "qqqD") {
+  auto p = Parser::parse(base);
+  vector<std::pair<string, std::function<Polyhedron(Polyhedron &)>>> ops = {
+      {"ambo", PolyOperations::ambo_flag},
+      {"gyro", PolyOperations::gyro},
+      {"quinto", PolyOperations::quinto}};
+
+  for (auto &op : ops) {
+    long ns[2], n = 0;
+    for (int radix = 0; radix < 2; radix++) {
+      Flag::use_radix = radix;
+      Flag::sort_ns = Flag::sort_n = 0;
+      op.second(p);
+      ns[radix] = Flag::sort_ns;
+      n = Flag::sort_n;
+    }
+    printf("%-6s %s: %ld keys, std::sort %.2fms, radix %.2fms\n",
+           op.first.c_str(), base.c_str(), n, ns[0] / 1e6, ns[1] / 1e6);
+  }
+  Flag::use_radix = true;
+}
+
+// flag key memory per operator: packed Key vs the Int4 layout it replaced
+// (I4Vix = Int4 + VertexIndex, MapIndex = 3 x Int4, fcs = Int4), and the
+// index_vertexes time (v sort + unique + coordinates gather)
+static void test_key_performance(string base = "qqqD") {
+  auto p = Parser::parse(base);
+  vector<std::pair<string, std::function<Polyhedron(Polyhedron &)>>> ops = {
+      {"kis", [](Polyhedron &p) { return PolyOperations::kisN_flag(p); }},
+      {"ambo", PolyOperations::ambo_flag},
+      {"gyro", PolyOperations::gyro},
+      {"dual", PolyOperations::dual_flag},
+      {"chamfer", [](Polyhedron &p) { return PolyOperations::chamfer(p); }},
+      {"whirl", [](Polyhedron &p) { return PolyOperations::whirl(p); }},
+      {"quinto", PolyOperations::quinto},
+      {"hollow", [](Polyhedron &p) { return PolyOperations::hollow(p); }}};
+
+  size_t int4_v = sizeof(Int4) + sizeof(VertexIndex),
+         int4_m = 3 * sizeof(Int4);
+
+  for (auto &op : ops) {
+    Flag::index_ns = 0;
+    op.second(p);
+    size_t nv = Flag::last_v, nm = Flag::last_m, nf = Flag::last_fcs;
+    size_t now = Flag::bytes(nv, nm, nf),
+           was = nv * int4_v + nm * int4_m + nf * sizeof(Int4);
+    printf("%-7s %s: v %ld, m %ld, fcs %ld keys, %.0fkb (Int4 %.0fkb, "
+           "%.1fx), index %.2fms\n",
+           op.first.c_str(), base.c_str(), nv, nm, nf, now / 1e3, was / 1e3,
+           double(was) / now, Flag::index_ns / 1e6);
+  }
+}
+
+// KeyFilter of the v segments per operator: emitted vs kept keys (shrink
+// ratio) and operator time without / with the filter
+static void test_filter_performance(string base = "qqqD") {
+  auto p = Parser::parse(base);
+  vector<std::pair<string, std::function<Polyhedron(Polyhedron &)>>> ops = {
+      {"kis", [](Polyhedron &p) { return PolyOperations::kisN_flag(p); }},
+      {"ambo", PolyOperations::ambo_flag},
+      {"gyro", PolyOperations::gyro},
+      {"chamfer", [](Polyhedron &p) { return PolyOperations::chamfer(p); }},
+      {"whirl", [](Polyhedron &p) { return PolyOperations::whirl(p); }},
+      {"quinto", PolyOperations::quinto},
+      {"persp1", PolyOperations::perspectiva1},
+      {"hollow", [](Polyhedron &p) { return PolyOperations::hollow(p); }}};
+
+  for (auto &op : ops) {
+    long ms[2];
+    for (int filter = 0; filter < 2; filter++) {
+      Flag::use_filter = filter;
+      Timer t;
+      op.second(p);
+      ms[filter] = t.lap();
+    }
+    size_t emitted = Flag::last_v, kept = emitted - Flag::last_dropped;
+    printf("%-7s %s: emitted %ld, kept %ld (%.2fx), %ldms -> %ldms\n",
+           op.first.c_str(), base.c_str(), emitted, kept,
+           double(emitted) / kept, ms[0], ms[1]);
+  }
+  Flag::use_filter = true;
+}
+
+// direct kernels vs the flag versions of kis, ambo & dual: same vertexes
+// and faces (index for index), and their times
+static void test_direct_performance(string base = "qqqqD") {
+  using Op = std::function<Polyhedron(Polyhedron &)>;
+  vector<std::tuple<string, Op, Op>> ops = {
+      {"kis", [](Polyhedron &p) { return PolyOperations::kisN_flag(p); },
+       [](Polyhedron &p) { return PolyOperations::kisN_direct(p); }},
+      {"kis5", [](Polyhedron &p) { return PolyOperations::kisN_flag(p, 5); },
+       [](Polyhedron &p) { return PolyOperations::kisN_direct(p, 5); }},
+      {"ambo", PolyOperations::ambo_flag, PolyOperations::ambo},
+      {"dual", PolyOperations::dual_flag, PolyOperations::dual}};
+
+  for (auto s : {"T", "C", "D", "A5", "J20", "dakC", base.c_str()}) {
+    auto p = Parser::parse(s);
+    for (auto &op : ops) {
+      Timer t;
+      auto pf = std::get<1>(op)(p);
+      long lf = t.lap();
+      t.start();
+      auto pd = std::get<2>(op)(p);
+      long ld = t.lap();
+      printf("%-5s %-6s: %s, flag %ldms, direct %ldms\n",
+             std::get<0>(op).c_str(), s, check(same(pf, pd)), lf, ld);
+    }
+  }
+}
+
+// face across each edge: Flag::gen_face_map (serial build, binary search
+// per lookup) vs the half-edges (parallel build, twin's face); build
+// times, lookups / s over all half-edges, same answers
+static void test_halfedges_performance(int n = 5) {
+  for (string s : {"qqqD", "kqqqqD", "qqqqqD"}) {
+    auto p = Parser::parse(s);
+    int ne = p.faces.n_indexes();
+    long ms[2][2] = {{0, 0}, {0, 0}};
+    bool same = true;
+
+    for (int i = 0; i < n; i++) {
+      Timer t;
+      auto face_map = Flag::gen_face_map(p);
+      ms[0][0] += t.lap();
+      t.start();
+      HalfEdges he(p.faces, p.n_vertex);
+      ms[1][0] += t.lap();
+
+      vector<Key> by_map(ne), by_he(ne);
+      t.start();
+      Thread(ne).run([&he, &face_map, &by_map](int q) {
+        by_map[q] = Flag::KeyInt::find(face_map, key(he.to(q), he.from(q)));
+      });
+      ms[0][1] += t.lap();
+      t.start();
+      Thread(ne).run([&he, &by_he](int q) {
+        by_he[q] = key(he.face[he.twin[q]]);
+      });
+      ms[1][1] += t.lap();
+      same &= by_map == by_he;
+    }
+    auto rate = [ne, n](long ms) { return ne * 1e-3 * n / max(ms, 1L); };
+    printf("%-7s %d half-edges: build face_map %ldms, half-edges %ldms; "
+           "lookups face_map %.0fM/s, half-edges %.0fM/s, %s\n",
+           s.c_str(), ne, ms[0][0] / n, ms[1][0] / n, rate(ms[0][1]),
+           rate(ms[1][1]), check(same));
+  }
+}
+
+// uN of an icosahedron: edge slots vs string keys + distance scan (up to
+// n = 32): V = 10n^2 + 2, F = 20n^2, closed; the same points (1e-4 grid,
+// +-1 cell). the scan merges only points closer than 1e-8, extra V: cracks
+static void test_trisub_performance(string s = "I", int reps = 10) {
+  auto p = Parser::parse(s);
+  for (int n : {2, 4, 8, 16, 32, 64}) {
+    Polyhedron u;
+    Timer t;
+    for (int r = 0; r < reps; r++)
+      u = PolyOperations::trisub(p, n);
+    double ms = double(t.lap()) / reps;
+    bool ok = long(u.n_vertex) == 10L * n * n + 2 &&
+              long(u.n_faces) == 20L * n * n && u.get_halfedges().closed;
+
+    string map = "-";
+    if (n <= 32) {
+      t.start();
+      auto um = PolyOperations::trisub_map(p, n);
+      map = to_string(t.lap()) + "ms, V=" + to_string(um.n_vertex) + ", " +
+            check(same_points(um, u), "same points");
+    }
+    printf("u%d%s: %.1fms, V=%ld F=%ld %s; map %s\n", n, s.c_str(), ms,
+           u.n_vertex, u.n_faces, check(ok, "closed", "WRONG"), map.c_str());
+  }
+}
+
+// GC(a, b) of an icosahedron, classes I, II, III: faces / s of the build
+// (projected), V = 10T + 2, F = 20T, closed, every vertex used; class I
+// has the points of trisub
+static void test_gc_performance(string s = "I", int reps = 3) {
+  auto p = Parser::parse(s);
+  int ab[][2] = {{1, 0}, {1, 1}, {2, 1}, {4, 0}, {3, 3},  {5, 2},
+                 {16, 0}, {10, 10}, {12, 7}, {64, 0}, {40, 40}, {60, 21},
+                 {128, 0}, {80, 80}, {120, 45}, {200, 100}};
+  for (auto &c : ab) {
+    int a = c[0], b = c[1];
+    long T = long(a) * a + long(a) * b + long(b) * b;
+    int n = std::max<long>(reps, 2000000 / (20 * T)); // >= 2M faces
+    Polyhedron u;
+    Timer t;
+    for (int r = 0; r < n; r++)
+      u = PolyOperations::goldberg_coxeter(p, a, b, true);
+    double ms = std::max(double(t.lap()) / n, 1e-3);
+
+    vector<bool> used(u.n_vertex);
+    for (auto v : u.faces.indexes)
+      used[v] = true;
+    float r = 0;
+    for (auto &v : u.vertexes)
+      r = std::max(r, abs(vec::length(v) - 1));
+    bool ok = long(u.n_vertex) == 10 * T + 2 && long(u.n_faces) == 20 * T &&
+              u.get_halfedges().closed && r < 1e-5f &&
+              std::find(used.begin(), used.end(), false) == used.end();
+    if (b == 0 && ok) {
+      auto w = PolyOperations::trisub(p, a);
+      auto sw = PolyOperations::spherize(w);
+      ok = same_points(u, sw);
+    }
+    printf("G%d,%d%s: %.3fms, V=%ld F=%ld %s, %.1f Mfaces/s\n", a, b,
+           s.c_str(), ms, u.n_vertex, u.n_faces, check(ok, "closed", "WRONG"),
+           u.n_faces / ms / 1000);
+  }
+}
+
+// compiled plans vs the notation as written, the times and the estimated
+// cost: the same shape where compile moves r or drops rr, SS (r before a
+// chiral step stays), the same # of vertexes and faces where it applies a
+// Conway identity (dd, ad, gd: same topology, other positions)
+static void test_compile_performance() {
+  for (auto s : {"ddqqD", "adqqqD", "dadqqqD", "gdqqD", "rqrqqD", "rrkqqD",
+                 "rgrgD", "dddkqqqD", "SSu8I", "ddHqqD", "HddqqD", "kqqqD",
+                 "grC", "prC", "wrC", "G3,1rI", "kqrqD", "qrgqD"}) {
+    Polyhedron p[2];
+    long ms[2];
+    Parser::use_cache = false;
+    for (int simple = 0; simple < 2; simple++) {
+      Parser::use_simplify = simple;
+      Timer t;
+      p[simple] = Parser::parse(s);
+      ms[simple] = t.lap();
+    }
+    Parser::use_cache = Parser::use_simplify = true;
+    bool identity = strstr(s, "dd") || strstr(s, "ad") || strstr(s, "gd");
+    bool ok = identity ? p[0].n_vertex == p[1].n_vertex &&
+                             p[0].n_faces == p[1].n_faces
+                       : same_shape(p[0], p[1]);
+    printf("%-9s: %s, %ldms -> %ldms, %s\n", s, check(ok), ms[0], ms[1],
+           Parser::compile(s).summary().c_str());
+  }
+}
+
+// predicted counts of the result vs the parsed one, the predicted peak vs
+// the result's bytes, and qqqqqqqqD (~50M edges) under a 256mb budget:
+// rejected before any step runs
+static void test_predict_performance() {
+  Parser::use_cache = false;
+  for (auto s : {"qqqqD", "k3qqD", "n5aI", "x4dC", "l3kT", "k4gC", "u5I",
+                 "G3,2dgT", "dadkP7", "PqD", "HqI", "dkaqY5", "SG2,1kJ20",
+                 "wcA5", "u3k5D"}) {
+    Timer t;
+    auto p = Parser::parse(s);
+    long ms = t.lap();
+    auto &plan = Parser::last_plan();
+    auto c = Counts::of(p, true);
+    bool ok = c.V == plan.counts.V && c.E == plan.counts.E &&
+              c.F == plan.counts.F;
+    printf("%-10s: %s, V%ld E%ld F%ld, peak %.1fmb, result %.1fmb, %ldms\n",
+           s, check(ok, "exact"), c.V, c.E, c.F, plan.peak / 1e6,
+           p.bytes() / 1e6, ms);
+  }
+
+  auto &adm = Parser::admission();
+  auto budget = adm.budget();
+  adm.set_budget(size_t(256) << 20), adm.reset_stats();
+  Timer t;
+  auto p = Parser::parse("qqqqqqqqD");
+  long ms = t.lap();
+  auto st = adm.stats();
+  printf("qqqqqqqqD: %ld vertexes in %ldms, %s, rejected %ld%s\n",
+         long(p.n_vertex), ms, Parser::last_plan().summary().c_str(),
+         st.rejected, check(st.rejected == 1 && !p.n_vertex, "", ", WRONG"));
+  adm.set_budget(budget), adm.reset_stats();
+  Parser::use_cache = true;
+}
+
+// interactive edits of a notation, each parsed as typed: from the seed
+// vs resumed from the cache (same polyhedra), and with a budget that
+// holds about one qqqqD: evictions. a hit's plan state
+static void test_cache_performance() {
+  vector<string> edits = {"qqqD",   "qqqqD",  "kqqqqD", "dkqqqqD", "qqqqD",
+                          "aqqqqD", "gqqqqD", "kqqqqD", "qqqqI",   "kqqqqI",
+                          "dqqqqD", "qqqD"};
+  auto &cache = Parser::cache();
+  auto run = [&edits, &cache](bool cached, size_t budget) {
+    Parser::use_cache = cached;
+    cache.clear(), cache.reset_stats(), cache.set_budget(budget);
+    vector<Polyhedron> ps;
+    Timer t;
+    for (auto &s : edits)
+      ps.push_back(Parser::parse(s));
+    long ms = t.lap();
+    Parser::use_cache = true;
+    return std::make_pair(ms, ps);
+  };
+
+  auto budget = cache.budget();
+  auto base = run(false, budget);
+  printf("from the seed: %ldms\n", base.first);
+  for (size_t mb : {256, 32, 8}) {
+    auto r = run(true, mb << 20);
+    bool ok = true;
+    for (size_t i = 0; i < edits.size(); i++)
+      ok &= same(r.second[i], base.second[i]);
+    auto st = cache.stats();
+    printf("cache %3ldmb: %ldms, %s, hits %ld, misses %ld, evictions %ld, "
+           "%ld entries %.1fmb\n",
+           mb, r.first, check(ok), st.hits, st.misses,
+           st.evictions, st.entries, st.bytes / 1e6);
+  }
+
+  // a hit restores the plan state of the parse it resumes: K convergence,
+  // predicted counts & peak. K100cccD does not converge
+  cache.clear();
+  string first = (Parser::parse("K100cccD"), Parser::last_plan().summary());
+  string again = (Parser::parse("K100cccD"), Parser::last_plan().summary());
+  Parser::parse("dK100cccD");
+  bool resumed = !Parser::last_plan().canonical;
+  printf("K100cccD: %s; again %s, dK100cccD %s\n", first.c_str(),
+         check(again == first), check(resumed, "not converged", "CONVERGED"));
+  cache.clear(), cache.reset_stats(), cache.set_budget(budget);
+}
+
+// attribute computations per parse (normals, centers, areas, colors): the
+// operators' inputs and the final recalc, each at most once
+static void test_attr_performance() {
+  auto &st = Polyhedron::attr_stats();
+  Parser::use_cache = false;
+  for (auto s : {"C", "kC", "dakC", "qqqD", "gpD", "HqC", "kkkkI"}) {
+    st.reset();
+    Timer t;
+    auto p = Parser::parse(s);
+    long ms = t.lap();
+    printf("%-6s: normals %ld, centers %ld, areas %ld, colors %ld, "
+           "halfedges %ld, %ldms\n",
+           s, long(st.normals), long(st.centers), long(st.areas),
+           long(st.colors), long(st.halfedges), ms);
+  }
+  Parser::use_cache = true;
+}
+
+// calc_normals + calc_centers + calc_areas (3 passes) vs calc_face_attrs
+static void test_face_attrs_performance(string s = "qqqqqqD", int n = 5) {
+  auto p = Parser::parse(s);
+  auto eq = [](auto &a, auto &b) {
+    return a.size() == b.size() &&
+           memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0;
+  };
+
+  Timer t;
+  for (int i = 0; i < n; i++) {
+    p.calc_normals();
+    p.calc_centers();
+    p.calc_areas();
+  }
+  long l3 = t.lap();
+  auto normals = p.get_normals(), centers = p.get_centers();
+  auto areas = p.get_areas();
+
+  t.start();
+  for (int i = 0; i < n; i++)
+    p.calc_face_attrs();
+  long l1 = t.lap();
+
+  bool same = eq(normals, p.get_normals()) &&
+              eq(centers, p.get_centers()) && eq(areas, p.get_areas());
+  printf("%s: %ld faces, 3 passes %.1fms, fused %.1fms (%.2fx), %s\n",
+         s.c_str(), p.n_faces, double(l3) / n, double(l1) / n,
+         double(l3) / std::max(l1, 1L), check(same));
+}
+
+// vec3 backend vs scalar (and apple simd): normal, distance, bounds
+// kernel on the first 3 vertexes of each face of s, n times
+static void test_vec_performance(string s = "qqqqqD", int n = 20) {
+  auto p = Parser::parse(s);
+  auto &vs = p.vertexes;
+  auto &fs = p.faces;
+
+  auto run = [&](auto kernel, auto to) { // -> ms, checksum
+    Timer t;
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+      for (auto face : fs)
+        sum += kernel(to(vs[face[0]]), to(vs[face[1]]), to(vs[face[2]]));
+    return pair<long, float>{t.lap(), sum};
+  };
+  auto id = [](const Vertex &v) { return v; };
+
+  auto vr = run(
+      [](const Vertex &a, const Vertex &b, const Vertex &c) {
+        auto nr = vec::normalize(vec::cross(b - a, c - b));
+        return vec::dot(nr, a) + vec::distance(a, c) + vec::reduce_max(nr);
+      },
+      id);
+  auto sr = run(
+      [](const Vertex &a, const Vertex &b, const Vertex &c) {
+        using namespace vec::scalar;
+        auto nr = normalize(cross(sub(b, a), sub(c, b)));
+        return dot(nr, a) + distance(a, c) + reduce_max(nr);
+      },
+      id);
+  printf("%s: %ld faces x %d, %s %ldms, scalar %ldms, %s\n", s.c_str(),
+         fs.size(), n, VEC3_BACKEND, vr.first, sr.first,
+         check(vr.second == sr.second));
+#ifdef __APPLE__
+  auto ar = run(
+      [](simd_float3 a, simd_float3 b, simd_float3 c) {
+        auto nr = simd::normalize(simd::cross(b - a, c - b));
+        return simd::dot(nr, a) + simd::distance(a, c) + simd_reduce_max(nr);
+      },
+      [](const Vertex &v) { return simd_make_float3(v.x, v.y, v.z); });
+  printf("apple simd %ldms\n", ar.first);
+#endif
+}
+
+// FaceKernels (avx2 batched by face size) vs the per face path:
+// calc_normals, calc_areas & calc_face_attrs times, n runs, and the largest
+// normal / relative area difference (rsqrt + fma: not bit exact, close)
+static void test_face_kernels_performance(int n = 10) {
+  for (string s : {"kqqqqD", "kkqqqD", "qqqqqD", "gqqqD"}) {
+    auto p = Parser::parse(s);
+    long ms[2][3];
+    Vertexes normals[2];
+    vector<float> areas[2];
+
+    for (int batched = 0; batched < 2; batched++) {
+      FaceKernels::enabled = batched;
+      Timer t;
+      for (int i = 0; i < n; i++)
+        p.calc_normals();
+      ms[batched][0] = t.lap();
+      t.start();
+      for (int i = 0; i < n; i++)
+        p.calc_areas();
+      ms[batched][1] = t.lap();
+      t.start();
+      for (int i = 0; i < n; i++)
+        p.calc_face_attrs();
+      ms[batched][2] = t.lap();
+      normals[batched] = p.get_normals(), areas[batched] = p.get_areas();
+    }
+    FaceKernels::enabled = true;
+
+    float dn = 0, da = 0;
+    for (size_t f = 0; f < p.n_faces; f++) {
+      dn = max(dn, vec::distance(normals[0][f], normals[1][f]));
+      da = max(da, abs(areas[0][f] - areas[1][f]) / areas[0][f]);
+    }
+    printf("%-7s %ld faces: normals %ld -> %ldms (%.1fx), areas %ld -> "
+           "%ldms, attrs %ld -> %ldms, diff %.1g %.1g %s\n",
+           s.c_str(), p.n_faces, ms[0][0], ms[1][0],
+           double(ms[0][0]) / max(ms[1][0], 1L), ms[0][1], ms[1][1],
+           ms[0][2], ms[1][2], dn, da,
+           check(dn < 1e-5f && da < 1e-3f, "close", "DIFFERENT"));
+  }
+}
+
+// K: iterations & time to tolerance (or a stall), the iterate kept (0: the
+// input), residuals before / after: never worse
+static void test_canonical_performance(
+    int max_iter = Canonical::default_iter,
+    float tol = Canonical::default_tol) {
+  for (string s : {"cD", "wD", "gC", "pC", "qD", "ggI", "wwC", "cccD",
+                   "gqqqD"}) {
+    auto p = Parser::parse(s);
+    auto vs = p.get_vertexes();
+    Canonical c(p.faces, p.get_halfedges());
+    float t0 = c.tangency(vs), p0 = c.planarity(vs);
+    auto st = c.run(vs, max_iter, tol);
+    float t1 = c.tangency(vs), p1 = c.planarity(vs);
+    printf("%-6s V=%ld: %d iterations %ldms (%.2fms/it), change %.1g %s, "
+           "kept %d, tangency %.2g -> %.2g, planarity %.2g -> %.2g %s\n",
+           s.c_str(), p.n_vertex, st.iterations, st.ms,
+           double(st.ms) / max(st.iterations, 1), st.change,
+           st.converged ? "converged"
+                        : st.stalled ? "stalled" : "budget spent",
+           st.best, t0, t1, p0, p1,
+           check(t1 + p1 <= (t0 + p0) * 1.0001f, "", "WORSE"));
+  }
+}
+
+// calc_colors: the former serial map<sigfigs, color> vs AreaClasses, the
+// class of each face must be the same
+static void test_colors_performance(int n = 10) {
+  for (string s : {"kqqqqD", "qqqqqD", "gqqqD", "cccD"}) {
+    auto p = Parser::parse(s);
+    auto &areas = p.get_areas();
+    vector<int> ref(areas.size()), cls(areas.size());
+
+    Timer t;
+    for (int i = 0; i < n; i++) {
+      map<int, int> dict; // sigfigs -> class, in order of first face
+      for (size_t f = 0; f < areas.size(); f++) {
+        auto k = AreaClasses::sigfigs(areas[f]);
+        if (dict.find(k) == dict.end())
+          dict[k] = dict.size();
+      }
+      for (size_t f = 0; f < areas.size(); f++)
+        ref[f] = dict[AreaClasses::sigfigs(areas[f])];
+    }
+    long ms_map = t.lap();
+
+    t.start();
+    int nc = 0;
+    for (int i = 0; i < n; i++)
+      nc = AreaClasses::classify(areas, [&cls](int f, int c) { cls[f] = c; });
+    long ms_cls = t.lap();
+
+    t.start();
+    for (int i = 0; i < n; i++)
+      p.calc_colors();
+    long ms_colors = t.lap();
+
+    printf("%-7s %zu faces, %d classes: map %ldms, classify %ldms (%.1fx), "
+           "calc_colors %ldms, %s\n",
+           s.c_str(), areas.size(), nc, ms_map, ms_cls,
+           double(ms_map) / max(ms_cls, 1L), ms_colors,
+           check(ref == cls));
+  }
+}
+
+// packed 12 byte Vertex vs the 16 byte (padded) layout: Polyhedron and
+// mesh (gl upload: vertex, normal & color per triangle corner) bytes of s,
+// scaled to 5M faces, and the time to fill the mesh arrays in each layout
+static void test_vertex_memory_performance(string s = "qqqqqqD") {
+  auto p = Parser::parse(s);
+  auto &faces = p.faces;
+  auto &normals = p.get_normals(), &colors = p.get_colors();
+  size_t nf = faces.size(), pad = sizeof(vec3) - sizeof(Vertex),
+         n3 = p.vertexes.size() + normals.size() + colors.size() +
+              p.get_centers().size(),
+         nt = 3 * (faces.n_indexes() - 2 * nf); // mesh corners
+  double mb5m = 5e6 / nf / 1e6;                 // -> Mb at 5M faces
+
+  auto fill = [&](auto *mesh) { // as Mesh::calc, fan triangulation
+    Timer t;
+    for (int i = 0; i < 3; i++)
+      mesh[i].resize(nt);
+    Thread(nf).run([&](int f) {
+      auto face = faces[f];
+      int ix = 3 * (faces.offsets[f] - 2 * f);
+      for (size_t i = 1; i + 1 < face.size(); i++)
+        for (int c : {face[0], face[i], face[i + 1]}) {
+          mesh[0][ix] = p.vertexes[c];
+          mesh[1][ix] = normals[f];
+          mesh[2][ix++] = colors[f];
+        }
+    });
+    return t.lap();
+  };
+  vector<Vertex> packed[3];
+  vector<vec3> padded[3];
+  long lp = fill(packed), l16 = fill(padded);
+
+  size_t poly = p.bytes(), mesh = 3 * nt * sizeof(Vertex);
+  printf("%s: %ld faces, poly %.1fMb (16 byte %.1fMb), mesh upload %.1fMb "
+         "(%.1fMb), fill %ldms (%ldms)\n",
+         s.c_str(), nf, poly / 1e6, (poly + n3 * pad) / 1e6, mesh / 1e6,
+         (mesh + 3 * nt * pad) / 1e6, lp, l16);
+  printf("at 5M faces: poly %.0fMb (%.0fMb), mesh upload %.0fMb (%.0fMb)\n",
+         poly * mb5m, (poly + n3 * pad) * mb5m, mesh * mb5m,
+         (mesh + 3 * nt * pad) * mb5m);
+}
+
+// operator chains parsed with and without fusion: same result, times
+static void test_fusion_performance() {
+  for (auto s : {"dkC", "daD", "dkdkdkD", "dkdkdkqqD", "dadadaqqD",
+                 "dkdadkqqqD", "dkgdadkqqD"}) {
+    Parser::use_cache = false;
+    Polyhedron p[2];
+    long ms[2];
+    for (int fused = 0; fused < 2; fused++) {
+      Parser::use_fusion = fused;
+      Timer t;
+      p[fused] = Parser::parse(s);
+      ms[fused] = t.lap();
+    }
+    printf("%-10s: %s, %ld vertexes, %ldms -> fused %ldms\n", s,
+           check(same(p[0], p[1])), p[1].vertexes.size(),
+           ms[0], ms[1]);
+  }
+  Parser::use_fusion = Parser::use_cache = true;
+}
+
+// CSR faces vs the equivalent vector<vector<int>>: memory, parse & copy time
+static void test_faces_performance() {
+  Parser::use_cache = false;
+  for (auto s : {"kkkkI", "qqqqqD"}) {
+    Timer t;
+    auto p = Parser::parse(s);
+    long lparse = t.lap();
+
+    t.start();
+    auto pc = p; // full Polyhedron copy
+    long lcopy = t.lap();
+
+    size_t nested = p.faces.size() * sizeof(Face); // + 1 heap block / face
+    for (auto face : p.faces)
+      nested += ((face.size() * sizeof(int) + 15) & ~15) + 16;
+
+    printf("%-6s: faces %ld, csr %.0fkb, vector<Face> ~%.0fkb, parse %ldms, "
+           "copy %ldms\n",
+           s, pc.faces.size(), p.faces.bytes() / 1e3, nested / 1e3, lparse,
+           lcopy);
+  }
+  Parser::use_cache = true;
+}
+
+// per slot utilization of the scheduled face loops
+static void test_scheduler_performance(string s = "qqqqD") {
+  Thread::reset_stats();
+  Parser::use_cache = false;
+  Timer t;
+  Parser::parse(s);
+  t.timer(s);
+  Parser::use_cache = true;
+  Thread::print_stats();
+}
+
+
+int main(int argc, const char *argv[]) {
+  vector<std::pair<string, std::function<void()>>> tests = {
+      {"tuple", [] { test_tuple_performance(); }},
+      {"dispatch", [] { test_dispatch_performance(); }},
+      {"sort", [] { test_sort_performance(); }},
+      {"key", [] { test_key_performance(); }},
+      {"filter", [] { test_filter_performance(); }},
+      {"direct", [] { test_direct_performance(); }},
+      {"halfedges", [] { test_halfedges_performance(); }},
+      {"trisub", [] { test_trisub_performance(); }},
+      {"gc", [] { test_gc_performance(); }},
+      {"compile", [] { test_compile_performance(); }},
+      {"predict", [] { test_predict_performance(); }},
+      {"cache", [] { test_cache_performance(); }},
+      {"attr", [] { test_attr_performance(); }},
+      {"face_attrs", [] { test_face_attrs_performance(); }},
+      {"vec", [] { test_vec_performance(); }},
+      {"face_kernels", [] { test_face_kernels_performance(); }},
+      {"canonical", [] { test_canonical_performance(); }},
+      {"colors", [] { test_colors_performance(); }},
+      {"vertex_memory", [] { test_vertex_memory_performance(); }},
+      {"fusion", [] { test_fusion_performance(); }},
+      {"faces", [] { test_faces_performance(); }},
+      {"scheduler", [] { test_scheduler_performance(); }},
+  };
+  for (auto &test : tests) {
+    bool run = argc == 1;
+    for (int i = 1; i < argc; i++)
+      run |= test.first == argv[i];
+    if (run) {
+      printf("-- %s\n", test.first.c_str());
+      test.second();
+    }
+  }
+  printf("%d failed checks\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+# benchmarks and regression checks of poly/, console: bench [names]
+# 'make check' runs them all, failing on any failed check
+
+QT -= core gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += .. ../poly
+
+#QMAKE_CXXFLAGS += -mavx2 -mfma
+#DEFINES += VEC3_SCALAR
+
+SOURCES += \
+    bench.cpp \
+    ../poly/common.cpp \
+    ../poly/johnson.cpp
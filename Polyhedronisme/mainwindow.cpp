@@ -24,8 +24,10 @@ void MainWindow::update() {
                             .toLocal8Bit()
                             .data()); // create the poly w/user input
     });
-    ui->statusbar->showMessage(QString::asprintf(
-        "# vertex: %ld, # faces: %ld, lap: %ld", p.n_vertex, p.n_faces, ts));
+    ui->statusbar->showMessage(
+        QString::asprintf("# vertex: %ld, # faces: %ld, lap: %ld, plan %s",
+                          p.n_vertex, p.n_faces, ts,
+                          Parser::last_plan().summary().c_str()));
 
     ui->shader->set_poly(&p);
 
@@ -32,7 +32,7 @@ public:
 
   map<int, vector<int>> gen_trigs_map(Polyhedron *poly) {
     map<int, vector<int>> tm;
-    for (auto &face : poly->faces)
+    for (auto face : poly->faces)
       if (tm.find(face.size()) == tm.end()) // not found->generate
         tm[face.size()] = triangularize(face.size());
     return tm;
@@ -43,23 +43,27 @@ public:
     init();
 
     auto trig_map = gen_trigs_map(poly);
+    auto &faces = poly->faces;
 
-    for (int iface = 0; iface < poly->faces.size(); iface++) {
+    // face f (fs sides) -> 3*(fs-2) trig vertexes starting at
+    // 3*(offsets[f]-2f)
+    n_triangles = 3 * (int(faces.n_indexes()) - 2 * int(faces.size()));
+    for (auto &m : mesh)
+      m.resize(n_triangles);
 
-      auto &face = poly->faces[iface];
-      int fs = face.size();
+    Thread(faces.size()).run([this, poly, &faces, &trig_map](int iface) {
+      auto face = faces[iface];
+      int fs = face.size(), ix = 3 * (faces.offsets[iface] - 2 * iface);
 
       auto color = poly->get_color(iface); // current color, normal
       auto normal = poly->get_normal(iface);
 
-      for (auto ixv : trig_map[fs]) { // set colors & normals for face vertex
-        mesh[e_vertex].push_back(poly->vertexes[face[ixv]]);
-        mesh[e_color].push_back(color);
-        mesh[e_normal].push_back(normal);
+      for (auto ixv : trig_map.at(fs)) { // set colors & normals for face vertex
+        mesh[e_vertex][ix] = poly->vertexes[face[ixv]];
+        mesh[e_color][ix] = color;
+        mesh[e_normal][ix++] = normal;
       }
-    }
-
-    n_triangles = mesh[e_vertex].size();
+    });
 
     return *this;
   }
@@ -10,110 +10,331 @@
 #define Thread_h
 
 #include "common.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 
 using std::thread, std::mutex;
 
-class Thread {
+// process wide pool of parked workers, created once on first use.
+// run(ntasks, task) hands out task(0..ntasks-1) to the workers and the
+// calling thread, and returns when all of them are done. each task index is
+// executed exactly once, so per slot data (i.e. one Flag per 't') is safe.
+class ThreadPool {
 public:
-  Thread()
-      : nth(int(thread::hardware_concurrency())), threads(new thread[nth]) {}
-  Thread(int size)
-      : nth(size < int(thread::hardware_concurrency())
-                ? size
-                : int(thread::hardware_concurrency())),
-        segSz(size > nth ? size / nth : 1), size(size),
-        threads(new thread[nth]), mtx(new mutex) {}
+  static ThreadPool &instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  int size() const { return nth; } // workers + caller
+  long dispatches() const { return n_dispatch; }
+
+  void run(int ntasks, std::function<void(int)> const &task) {
+    if (ntasks <= 0)
+      return;
+    n_dispatch++;
+
+    // nested dispatch from a worker or a single task -> run inline
+    if (in_pool() || ntasks == 1 || workers.empty()) {
+      for (int t = 0; t < ntasks; t++)
+        task(t);
+      return;
+    }
 
-  ~Thread() {
-    delete[] threads;
-    delete mtx;
+    std::lock_guard<mutex> run_lock(run_mtx); // one dispatch at a time
+
+    {
+      std::lock_guard<mutex> lock(mtx);
+      this->task = &task;
+      this->ntasks = ntasks;
+      next = 0;
+      done = 0;
+      generation++;
+    }
+    cv_start.notify_all();
+
+    in_pool() = true; // caller participates
+    drain();
+    in_pool() = false;
+
+    std::unique_lock<mutex> lock(mtx);
+    cv_done.wait(lock, [this] { return done == this->ntasks && active == 0; });
+    this->task = nullptr;
   }
-  static int getnthreads() { return int(thread::hardware_concurrency()); }
+
+private:
+  ThreadPool()
+      : nth(std::max(1, int(thread::hardware_concurrency()))) {
+    for (int i = 0; i < nth - 1; i++) // caller is the nth worker
+      workers.emplace_back([this] { worker(); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<mutex> lock(mtx);
+      stop = true;
+    }
+    cv_start.notify_all();
+    for (auto &w : workers)
+      w.join();
+  }
+
+  static bool &in_pool() {
+    static thread_local bool in = false;
+    return in;
+  }
+
+  void worker() {
+    in_pool() = true;
+    unsigned seen = 0;
+
+    for (;;) {
+      {
+        std::unique_lock<mutex> lock(mtx);
+        cv_start.wait(lock, [this, seen] { return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+        if (task == nullptr)
+          continue; // woke after the job was already collected
+        active++;
+      }
+
+      drain();
+
+      {
+        std::lock_guard<mutex> lock(mtx);
+        active--;
+      }
+      cv_done.notify_all();
+    }
+  }
+
+  void drain() { // grab task indexes until exhausted
+    int n_done = 0;
+    for (int t; (t = next++) < ntasks; n_done++)
+      (*task)(t);
+
+    if (n_done) {
+      std::lock_guard<mutex> lock(mtx);
+      done += n_done;
+    }
+  }
+
+  int nth;
+  std::vector<thread> workers;
+
+  mutex mtx, run_mtx;
+  std::condition_variable cv_start, cv_done;
+
+  std::function<void(int)> const *task = nullptr;
+  int ntasks = 0, done = 0, active = 0;
+  std::atomic<int> next{0};
+  std::atomic<long> n_dispatch{0};
+  unsigned generation = 0;
+  bool stop = false;
+};
+
+// per slot utilization, accumulated over all scheduled runs
+struct ThreadStats {
+  std::atomic<long> items{0}, chunks{0}, steals{0}, busy_ns{0};
+};
+
+// Thread splits [0,size) among nth slots of the pool. the per index run()
+// overloads are scheduled in chunks of 'grain' indexes: each slot starts on
+// its own range (equal count or, with a cost hint, equal cost) and, once it
+// is exhausted, steals half of the largest remaining range of another slot.
+// 't' passed to the lambda is the executing slot, never shared at a time.
+class Thread {
+public:
+  Thread() : nth(getnthreads()), mtx(new mutex) {}
+  Thread(int size, int grain = 0)
+      : nth(size < getnthreads() ? size : getnthreads()),
+        segSz(size > nth ? size / nth : 1), size(size), mtx(new mutex) {
+    set_grain(grain);
+  }
+  Thread(int size, std::function<int(int)> const &cost, int grain = 0)
+      : Thread(size, grain) {
+    split_by_cost(cost);
+  }
+
+  ~Thread() { delete mtx; }
+  static int getnthreads() { return ThreadPool::instance().size(); }
 
   int from(int t) { return t * segSz; }
   int to(int t) { return ((t == nth - 1) ? size : (t + 1) * segSz); }
 
+  // static segments, one per slot
   void run(std::function<void(int, int, int)> const &lambda) { // t, from, to
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() { lambda(t, from(t), to(t)); });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    dispatch([this, &lambda](int t) { lambda(t, from(t), to(t)); });
   }
 
   void run_once_per_thread(std::function<void(int)> const &lambda) { // i
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([lambda, t]() { lambda(t); });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    dispatch(lambda);
   }
 
+  // chunked, work stealing
   void run(std::function<void(int)> const &lambda) { // i
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() {
-        for (int i = from(t); i < to(t); i++)
-          lambda(i);
-      });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    schedule([&lambda](int, int i) { lambda(i); });
   }
 
   void run(std::function<void(int, int)> const &lambda) { // t, i
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() {
-        for (int i = from(t); i < to(t); i++)
-          lambda(t, i);
-      });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    schedule(lambda);
   }
 
   void run(std::function<void(void)> const &lambda) { // ()
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() {
-        for (int i = from(t); i < to(t); i++)
-          lambda();
-      });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    schedule([&lambda](int, int) { lambda(); });
   }
 
   void run(std::function<void(int, mutex *mtx)> const &lambda) { // i
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() {
-        for (int i = from(t); i < to(t); i++)
-          lambda(i, mtx);
-      });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    schedule([this, &lambda](int, int i) { lambda(i, mtx); });
   }
 
   void run(std::function<void(int, int, mutex*mtx)> const &lambda) { // t, i
-    for (int t = 0; t < nth; t++) {
-      threads[t] = thread([this, lambda, t]() {
-        for (int i = from(t); i < to(t); i++)
-          lambda(t, i, mtx);
-      });
-    }
-    for (int t = 0; t < nth; t++)
-      threads[t].join();
+    schedule([this, &lambda](int t, int i) { lambda(t, i, mtx); });
   }
 
-
   void lock() { mtx->lock(); }
   void unlock() { mtx->unlock(); }
 
-  int nth = int(thread::hardware_concurrency()), segSz = 0, size = 0;
-  thread *threads = nullptr;
+  // utilization
+  static ThreadStats *stats() {
+    static std::unique_ptr<ThreadStats[]> st(new ThreadStats[getnthreads()]);
+    return st.get();
+  }
+  static std::atomic<long> &wall_ns() {
+    static std::atomic<long> ns{0};
+    return ns;
+  }
+  static void reset_stats() {
+    for (int t = 0; t < getnthreads(); t++) {
+      auto &st = stats()[t];
+      st.items = st.chunks = st.steals = st.busy_ns = 0;
+    }
+    wall_ns() = 0;
+  }
+  static void print_stats() {
+    double wall = double(wall_ns());
+    printf("slot   items  chunks  steals  busy%%\n");
+    for (int t = 0; t < getnthreads(); t++) {
+      auto &st = stats()[t];
+      printf("%4d %7ld %7ld %7ld %5.1f\n", t, long(st.items), long(st.chunks),
+             long(st.steals), wall ? 100. * long(st.busy_ns) / wall : 0.);
+    }
+  }
+
+  int nth = getnthreads(), segSz = 0, size = 0, grain = 1;
 
   mutex *mtx = nullptr; // same mutex for all threads
+
+private:
+  vector<int> bounds; // initial range of slot t: bounds[t]..bounds[t+1]
+
+  void dispatch(std::function<void(int)> const &task) {
+    ThreadPool::instance().run(nth, task);
+  }
+
+  void set_grain(int grain) {
+    this->grain = grain > 0 ? grain : std::max(1, size / (nth * 8 + 1));
+  }
+
+  void split_by_cost(std::function<int(int)> const &cost) {
+    if (nth <= 1)
+      return;
+    vector<long> acc(size + 1, 0); // prefix sum of cost
+    for (int i = 0; i < size; i++)
+      acc[i + 1] = acc[i] + cost(i);
+
+    bounds.resize(nth + 1);
+    bounds[0] = 0;
+    for (int t = 1; t < nth; t++)
+      bounds[t] = int(std::lower_bound(acc.begin(), acc.end(),
+                                       acc[size] * t / nth) -
+                      acc.begin());
+    bounds[nth] = size;
+  }
+
+  static uint64_t pack(int b, int e) { return (uint64_t(b) << 32) | uint32_t(e); }
+  static int begin_of(uint64_t r) { return int(r >> 32); }
+  static int end_of(uint64_t r) { return int(uint32_t(r)); }
+
+  void schedule(std::function<void(int, int)> const &lambda) { // t, i
+    using clock = std::chrono::high_resolution_clock;
+    auto ns = [](clock::time_point t0) {
+      return long(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      clock::now() - t0)
+                      .count());
+    };
+    auto t0 = clock::now();
+
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges(
+        new std::atomic<uint64_t>[std::max(nth, 1)]);
+    for (int t = 0; t < nth; t++)
+      ranges[t] = bounds.empty() ? pack(from(t), to(t))
+                                 : pack(bounds[t], bounds[t + 1]);
+
+    auto take_front = [this, &ranges](int t, int &b, int &e) {
+      auto &r = ranges[t];
+      for (uint64_t cur = r.load();;) {
+        int rb = begin_of(cur), re = end_of(cur);
+        if (rb >= re)
+          return false;
+        int nb = std::min(re, rb + grain);
+        if (r.compare_exchange_weak(cur, pack(nb, re))) {
+          b = rb, e = nb;
+          return true;
+        }
+      }
+    };
+
+    auto steal_back = [this, &ranges](int t) { // largest victim -> own range
+      for (;;) {
+        int victim = -1, most = 0;
+        for (int v = 0; v < nth; v++) {
+          uint64_t cur = ranges[v].load();
+          if (end_of(cur) - begin_of(cur) > most)
+            most = end_of(cur) - begin_of(cur), victim = v;
+        }
+        if (victim == -1)
+          return false; // all done
+
+        auto &r = ranges[victim];
+        uint64_t cur = r.load();
+        int rb = begin_of(cur), re = end_of(cur);
+        if (rb >= re)
+          continue;
+        int ne = std::max(rb, re - std::max(grain, (re - rb) / 2));
+        if (r.compare_exchange_strong(cur, pack(rb, ne))) {
+          ranges[t] = pack(ne, re);
+          return true;
+        }
+      }
+    };
+
+    dispatch([&](int t) {
+      auto t1 = clock::now();
+      auto &st = stats()[t];
+      long items = 0, chunks = 0, steals = 0;
+
+      do {
+        for (int b, e; take_front(t, b, e); chunks++, items += e - b)
+          for (int i = b; i < e; i++)
+            lambda(t, i);
+      } while (steal_back(t) && ++steals);
+
+      st.items += items;
+      st.chunks += chunks;
+      st.steals += steals;
+      st.busy_ns += ns(t1);
+    });
+
+    wall_ns() += ns(t0);
+  }
 };
 
 #endif /* Thread_h */
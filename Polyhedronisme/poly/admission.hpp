@@ -0,0 +1,114 @@
+//
+//  admission.hpp
+//  test_polygon
+//
+
+#ifndef admission_hpp
+#define admission_hpp
+
+#include "common.hpp"
+#include <condition_variable>
+#include <mutex>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h> // sysconf
+#endif
+
+// memory admission of parse jobs by their predicted peak bytes: a job over
+// the budget alone is rejected, one that fits it waits (queued) until the
+// jobs running release enough. one per process (Parser::admission), thread
+// safe. default budget: half the physical memory
+class Admission {
+public:
+  struct Stats {
+    long admitted = 0;
+    long queued = 0;   // admitted after waiting
+    long rejected = 0; // over the budget alone
+    size_t in_use = 0, peak = 0;
+  };
+
+  // admitted bytes, released by the destructor
+  class Ticket {
+  public:
+    Ticket() {}
+    Ticket(Admission *a, size_t bytes) : a(a), bytes(bytes) {}
+    Ticket(Ticket &&t) : a(t.a), bytes(t.bytes) { t.a = nullptr; }
+    Ticket &operator=(Ticket &&t) {
+      std::swap(a, t.a), std::swap(bytes, t.bytes);
+      return *this;
+    }
+    ~Ticket() {
+      if (a)
+        a->release(bytes);
+    }
+    explicit operator bool() const { return a != nullptr; }
+
+  private:
+    Admission *a = nullptr;
+    size_t bytes = 0;
+  };
+
+  explicit Admission(size_t budget = physical() / 2) : max_bytes(budget) {}
+
+  void set_budget(size_t budget) {
+    std::lock_guard<std::mutex> lock(mtx);
+    max_bytes = budget;
+    freed.notify_all();
+  }
+  size_t budget() const { return max_bytes; }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    st.in_use = in_use;
+    return st;
+  }
+  void reset_stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    st = Stats();
+  }
+
+  // a ticket for bytes, waiting for room; an empty one if over the budget
+  Ticket acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (bytes > max_bytes) {
+      st.rejected++;
+      return Ticket();
+    }
+    if (in_use + bytes > max_bytes) {
+      st.queued++;
+      freed.wait(lock, [&] {
+        return in_use + bytes <= max_bytes || bytes > max_bytes;
+      });
+      if (bytes > max_bytes) { // budget lowered while waiting
+        st.rejected++;
+        return Ticket();
+      }
+    }
+    in_use += bytes;
+    st.admitted++;
+    st.peak = std::max(st.peak, in_use);
+    return Ticket(this, bytes);
+  }
+
+  static size_t physical() {
+#ifdef _SC_PHYS_PAGES
+    long pages = sysconf(_SC_PHYS_PAGES), size = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && size > 0)
+      return size_t(pages) * size_t(size);
+#endif
+    return size_t(8) << 30;
+  }
+
+private:
+  std::mutex mtx;
+  std::condition_variable freed;
+  size_t max_bytes, in_use = 0;
+  Stats st;
+
+  void release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    in_use -= bytes;
+    freed.notify_all();
+  }
+};
+
+#endif /* admission_hpp */
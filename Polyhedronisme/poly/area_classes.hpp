@@ -0,0 +1,146 @@
+//
+//  area_classes.hpp
+//  test_polygon
+//
+
+#ifndef area_classes_hpp
+#define area_classes_hpp
+
+#include "Thread.h"
+#include "common.hpp"
+#include <cstring>
+
+// face classes of calc_colors: areas with the same 2 significant digits,
+// magnitude ignored (sigfigs). positive floats order as their bits, so
+// sigfigs is a step function of the bits: its steps are found once per
+// binade (bisection of the bits, sigfigs at the ends) and key() is a search
+// in the steps of the exponent, no log10f / powf. same libm, same steps:
+// the same keys as sigfigs, the same partition. a class is numbered by the
+// first face it has (the order of the former map inserts), in parallel
+class AreaClasses {
+public:
+  static const int n_slots = 129; // keys 0..127, the rest (nan, inf) in 128
+
+  // the 2 significant digits rule: 10..100, 0 for 0
+  static int sigfigs(float f, int nsigs = 2) {
+    if (f == 0.f)
+      return 0;
+    float mantissa = f / powf(10, floor(log10f(f)));
+    return int(roundf(mantissa * powf(10, (nsigs - 1))));
+  }
+
+  static int key(float f) {
+    if (f == 0.f)
+      return 0;
+    if (!(f > 0.f && f < INFINITY))
+      return sigfigs(f); // out of the table: as it was
+    auto &st = steps();
+    uint32_t b = bits(f), e = b >> 23;
+    auto it = std::upper_bound(st.at.begin() + st.first[e],
+                               st.at.begin() + st.first[e + 1], b);
+    return st.key[it - st.at.begin() - 1];
+  }
+
+  // paint(f, c): class c = 0.. of face f, classes numbered by their first
+  // face. returns the # of classes
+  template <class Paint>
+  static int classify(const vector<float> &areas, Paint paint) {
+    int n = areas.size();
+    vector<uint8_t> slots(n);
+    Thread th(n);
+    vector<int> firsts(th.nth * n_slots, n); // first face of slot, per t
+
+    th.run([n, &areas, &slots, &firsts](int t, int from, int to) {
+      int *first = firsts.data() + t * n_slots;
+      for (int f = from; f < to; f++) {
+        int k = key(areas[f]), s = k >= 0 && k < n_slots - 1 ? k : n_slots - 1;
+        slots[f] = s;
+        if (first[s] == n)
+          first[s] = f;
+      }
+    });
+
+    vector<pair<int, int>> order; // first face, slot
+    for (int s = 0; s < n_slots; s++) {
+      int first = n;
+      for (int t = 0; t < th.nth; t++)
+        first = std::min(first, firsts[t * n_slots + s]);
+      if (first < n)
+        order.push_back({first, s});
+    }
+    std::sort(order.begin(), order.end());
+    int cls[n_slots];
+    for (size_t c = 0; c < order.size(); c++)
+      cls[order[c].second] = c;
+
+    Thread(n).run([&slots, &cls, &paint](int f) { paint(f, cls[slots[f]]); });
+    return order.size();
+  }
+
+private:
+  struct Steps { // key[i] for the bits at[i] .. at[i+1]-1
+    vector<uint32_t> at;
+    vector<int> key;
+    int first[257]; // steps of exponent e: first[e] .. first[e+1]-1
+  };
+
+  static uint32_t bits(float f) {
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return b;
+  }
+  static int key_of_bits(uint32_t b) {
+    float f;
+    memcpy(&f, &b, sizeof(f));
+    return sigfigs(f);
+  }
+
+  // each binade [lo, hi) spans a factor 2, less than a decade: its ends
+  // have the same key only if it has no step
+  static void bisect(uint32_t lo, int klo, uint32_t hi, int khi, Steps &st) {
+    if (klo == khi)
+      return;
+    if (hi == lo + 1) {
+      st.at.push_back(hi);
+      st.key.push_back(khi);
+      return;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    int kmid = key_of_bits(mid);
+    bisect(lo, klo, mid, kmid, st);
+    bisect(mid, kmid, hi, khi, st);
+  }
+
+  static Steps &steps() { // built on first use, exponents in parallel
+    static Steps steps = [] {
+      vector<Steps> per_exp(255);
+      Thread(255).run([&per_exp](int e) {
+        auto &st = per_exp[e];
+        auto binade = [&st](uint32_t lo, uint32_t hi) {
+          int klo = key_of_bits(lo);
+          st.at.push_back(lo);
+          st.key.push_back(klo);
+          bisect(lo, klo, hi - 1, key_of_bits(hi - 1), st);
+        };
+        if (e == 0) // denormals: 23 binades of the mantissa
+          for (uint32_t lo = 1; lo < 1u << 23; lo <<= 1)
+            binade(lo, lo << 1);
+        else
+          binade(uint32_t(e) << 23, uint32_t(e + 1) << 23);
+      });
+
+      Steps st;
+      for (int e = 0; e < 255; e++) {
+        st.first[e] = st.at.size();
+        st.at.insert(st.at.end(), per_exp[e].at.begin(), per_exp[e].at.end());
+        st.key.insert(st.key.end(), per_exp[e].key.begin(),
+                      per_exp[e].key.end());
+      }
+      st.first[255] = st.first[256] = st.at.size();
+      return st;
+    }();
+    return steps;
+  }
+};
+
+#endif /* area_classes_hpp */
@@ -0,0 +1,232 @@
+//
+//  canonical.hpp
+//  test_polygon
+//
+
+#ifndef canonical_hpp
+#define canonical_hpp
+
+#include "Thread.h"
+#include "common.hpp"
+#include "halfedges.hpp"
+
+// canonical form, as polyhedronisme's canonicalize: each iteration moves
+// the edges toward tangency to the unit sphere, the mean of their tangent
+// points to the origin and the vertexes toward the planes of their faces,
+// until no vertex moves more than tol or max_iter is spent. the result is
+// the iterate of the lowest residual (tangency + planarity, every 'probe'
+// iterations and the last), the input if none is lower; then max |v| = 1.
+// all passes are parallel gathers over csr lists: per edge, per vertex (its
+// edges), per face, per vertex (its faces). no scatter, no atomics; sums of
+// fixed blocks in order: the same result for any # of threads
+class Canonical {
+public:
+  struct Stats {
+    int iterations = 0;
+    float change = 0; // max vertex move of the last iteration
+    long ms = 0;
+    bool converged = false;
+    bool stalled = false; // change not down 1% in 'stall' iterations
+    int best = 0; // iteration of the vertexes returned, 0: the input's
+    float residual0 = 0, residual = 0; // tangency + planarity: in, out
+  };
+  static Stats &last() { // of the latest run (of the thread)
+    static thread_local Stats st;
+    return st;
+  }
+
+  static constexpr float stability = 0.1f; // damping of both moves
+  // the operator outputs tried (gC wD cD pC qD ggI wwC pgD gqD...) converge
+  // within 3200 iterations of tol 2e-5
+  static constexpr int default_iter = 4000, stall = 500, probe = 50;
+  static constexpr float default_tol = 2e-5f;
+
+  Canonical(const Faces &faces, const HalfEdges &he)
+      : faces(faces), nv(he.out_offsets.size() - 1) {
+    int nh = faces.n_indexes();
+
+    for (int p = 0; p < nh; p++) // one per pair of twins, borders too
+      if (he.twin[p] == -1 || p < he.twin[p]) {
+        ends.push_back(he.from(p));
+        ends.push_back(he.to(p));
+      }
+    ne = ends.size() / 2;
+
+    e_offsets.assign(nv + 1, 0); // edges of each vertex
+    for (auto v : ends)
+      e_offsets[v + 1]++;
+    for (int v = 0; v < nv; v++)
+      e_offsets[v + 1] += e_offsets[v];
+    v_edges.resize(ends.size());
+    vector<int> at(e_offsets.begin(), e_offsets.end() - 1);
+    for (int i = 0; i < int(ends.size()); i++)
+      v_edges[at[ends[i]]++] = i / 2;
+
+    f_offsets = he.out_offsets; // faces of each vertex: one leaving corner
+    v_faces.resize(nh);
+    Thread(nh).run([this, &he](int i) { v_faces[i] = he.face[he.out[i]]; });
+
+    shifts.resize(ne), moved.resize(nv);
+    normals.resize(faces.size()), centers.resize(faces.size());
+  }
+
+  Stats run(Vertexes &vs, int max_iter = default_iter,
+            float tol = default_tol) {
+    Timer t;
+    Stats st;
+    Vertexes in = vs, best_vs;
+    st.residual0 = st.residual = residual(vs);
+    auto keep = [this, &vs, &st, &best_vs] { // vs if its residual is lower
+      float r = residual(vs);
+      if (r < st.residual)
+        st.residual = r, st.best = st.iterations, best_vs = vs;
+    };
+
+    float best = __FLT_MAX__;
+    for (int since = 0; st.iterations < max_iter && !st.converged;) {
+      tangentify(vs);
+      planarize(vs, st.change);
+      st.converged = st.change < tol;
+      if (++st.iterations % probe == 0)
+        keep();
+      if (st.change < best * 0.99f)
+        best = st.change, since = 0;
+      else if (++since == stall) { // oscillating
+        st.stalled = true;
+        break;
+      }
+    }
+    if (st.iterations % probe)
+      keep();
+
+    if (st.best) {
+      vs = std::move(best_vs);
+      rescale(vs);
+    } else
+      vs = std::move(in);
+    st.ms = t.lap();
+    return last() = st;
+  }
+
+  // residuals, scale free: spread of the tangent point radii (max - min) /
+  // max, max distance of a vertex to the plane of its face / max |v|
+  float tangency(const Vertexes &vs) const {
+    float lo = __FLT_MAX__, hi = 0;
+    for (int e = 0; e < ne; e++) {
+      float r = vec::length(tangent_point(vs, e));
+      lo = std::min(lo, r), hi = std::max(hi, r);
+    }
+    return hi > 0 ? (hi - lo) / hi : 0;
+  }
+  float planarity(const Vertexes &vs) const {
+    float m = 0;
+    for (int f = 0; f < int(faces.size()); f++) {
+      vec3 n, c;
+      plane(vs, f, n, c);
+      for (auto v : faces[f])
+        m = std::max(m, abs(vec::dot(n, c - vs[v])));
+    }
+    float r = 0;
+    for (auto &v : vs)
+      r = std::max(r, vec::length(v));
+    return r > 0 ? m / r : 0;
+  }
+  float residual(const Vertexes &vs) const {
+    return tangency(vs) + planarity(vs);
+  }
+
+private:
+  static const int block = 4096; // edges per partial sum
+
+  const Faces &faces;
+  int nv, ne = 0;
+  vector<int> ends;                // a, b of edge e: ends[2e], ends[2e+1]
+  vector<int> e_offsets, v_edges;  // edges of vertex v
+  vector<int> f_offsets, v_faces;  // faces of vertex v
+  Vertexes shifts, moved;          // per edge, per vertex
+  Vertexes normals, centers;       // per face
+
+  // the point of line a-b closest to the origin
+  inline vec3 tangent_point(const Vertexes &vs, int e) const {
+    vec3 a = vs[ends[2 * e]], d = vec3(vs[ends[2 * e + 1]]) - a;
+    return a - d * (vec::dot(d, a) / vec::dot(d, d));
+  }
+
+  // mean normal of the corners, flipped outward, and centroid
+  inline void plane(const Vertexes &vs, int f, vec3 &n, vec3 &c) const {
+    auto face = faces[f];
+    int fl = face.size();
+    vec3 v1 = vs[face[fl - 2]], v2 = vs[face[fl - 1]];
+    n = 0, c = 0;
+    for (int i = 0; i < fl; i++) {
+      vec3 v3 = vs[face[i]];
+      n += vec::cross(v2 - v1, v3 - v2);
+      c += v3;
+      v1 = v2, v2 = v3;
+    }
+    c /= fl;
+    float l = vec::length(n);
+    n = l > 0 ? n / (vec::dot(n, c) < 0 ? -l : l) : vec3(0);
+  }
+
+  // edges: each end moves by (1 - |t|) t, t its tangent point; then all
+  // vertexes by minus the mean of the tangent points -> moved
+  void tangentify(const Vertexes &vs) {
+    int nb = (ne + block - 1) / block;
+    Vertexes sums(nb);
+    Thread(nb).run([this, &vs, &sums](int b) {
+      vec3 sum = 0;
+      for (int e = b * block; e < std::min(ne, (b + 1) * block); e++) {
+        vec3 t = tangent_point(vs, e);
+        shifts[e] = t * (stability / 2 * (1 - vec::length(t)));
+        sum += t;
+      }
+      sums[b] = sum;
+    });
+    vec3 center = 0;
+    for (auto &s : sums)
+      center += s;
+    if (ne)
+      center /= ne;
+
+    Thread(nv).run([this, &vs, center](int v) {
+      vec3 p = vs[v];
+      for (int i = e_offsets[v]; i < e_offsets[v + 1]; i++)
+        p += shifts[v_edges[i]];
+      moved[v] = p - center;
+    });
+  }
+
+  // faces: planes of moved; each vertex toward the planes of its faces
+  // -> vs, change = max move since the previous iteration
+  void planarize(Vertexes &vs, float &change) {
+    Thread(faces.size()).run([this](int f) {
+      vec3 n, c;
+      plane(moved, f, n, c);
+      normals[f] = n, centers[f] = c;
+    });
+
+    vector<float> maxs(Thread::getnthreads(), 0);
+    Thread(nv).run([this, &vs, &maxs](int t, int v) {
+      vec3 p = moved[v], q = p;
+      for (int i = f_offsets[v]; i < f_offsets[v + 1]; i++) {
+        vec3 n = normals[v_faces[i]];
+        q += n * (stability * vec::dot(n, vec3(centers[v_faces[i]]) - p));
+      }
+      maxs[t] = std::max(maxs[t], vec::distance(q, vs[v]));
+      vs[v] = q;
+    });
+    change = *std::max_element(maxs.begin(), maxs.end());
+  }
+
+  void rescale(Vertexes &vs) {
+    float m = 0;
+    for (auto &v : vs)
+      m = std::max(m, vec::length(v));
+    if (m > 0)
+      for (auto &v : vs)
+        v /= m;
+  }
+};
+
+#endif /* canonical_hpp */
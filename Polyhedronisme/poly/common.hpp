@@ -10,9 +10,12 @@
 #define common_h
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
 #include <map>
 #include <set>
-#include <simd/simd.h>
 #include <stdlib.h>
 #include <string>
 #include <tuple>
@@ -20,6 +23,7 @@
 #include <vector>
 
 #include "Timer.h"
+#include "vec3.hpp"
 
 #pragma clang diagnostic ignored "-Wc++17-extensions"
 #pragma clang diagnostic ignored "-Wimplicit-float-conversion"
@@ -36,12 +40,117 @@ using std::vector, std::string, std::map, std::to_string, std::pair,
     std::reverse, std::min, std::max, std::tuple, std::copy, std::get,
     std::lower_bound, std::inserter, std::unordered_set;
 
-using Vertex = simd_float3;
+using Vertex = float3; // packed storage, computed as vec3
 using Vertexes = vector<Vertex>;
 using Face = vector<int>;
-using Faces = vector<Face>;
 using VertexesFloat = vector<vector<float>>;
 
+// compressed face storage (CSR): face f is
+// indexes[offsets[f]..offsets[f+1]), allocated once from the face sizes
+class Faces {
+public:
+  template <class T> class FaceRef { // view of a face, T: int | const int
+  public:
+    inline FaceRef(T *b, T *e) : b(b), e(e) {}
+
+    inline T *begin() const { return b; }
+    inline T *end() const { return e; }
+    inline size_t size() const { return e - b; }
+    inline bool empty() const { return b == e; }
+    inline T &operator[](size_t i) const { return b[i]; }
+    inline T &front() const { return *b; }
+    inline T &back() const { return e[-1]; }
+
+    operator Face() const { return Face(b, e); }
+
+  private:
+    T *b, *e;
+  };
+
+  template <class F, class R> class Iterator { // F: (const) Faces
+  public:
+    inline Iterator(F *faces, size_t f) : faces(faces), f(f) {}
+    inline R operator*() const { return (*faces)[f]; }
+    inline Iterator &operator++() {
+      f++;
+      return *this;
+    }
+    inline bool operator!=(const Iterator &o) const { return f != o.f; }
+
+  private:
+    F *faces;
+    size_t f;
+  };
+
+  using face_ref = FaceRef<int>;
+  using const_face_ref = FaceRef<const int>;
+  using iterator = Iterator<Faces, face_ref>;
+  using const_iterator = Iterator<const Faces, const_face_ref>;
+
+  Faces() : offsets(1, 0) {}
+  explicit Faces(const vector<int> &sizes) : offsets(sizes.size() + 1) {
+    offsets[0] = 0;
+    for (size_t f = 0; f < sizes.size(); f++)
+      offsets[f + 1] = offsets[f] + sizes[f];
+    indexes.resize(offsets.back());
+  }
+  Faces(const vector<Face> &faces) : offsets(1, 0) {
+    reserve(faces.size(), count(faces.begin(), faces.end()));
+    for (auto &face : faces)
+      push_back(face);
+  }
+  Faces(std::initializer_list<Face> faces) : offsets(1, 0) {
+    reserve(faces.size(), count(faces.begin(), faces.end()));
+    for (auto &face : faces)
+      push_back(face);
+  }
+
+  inline size_t size() const { return offsets.size() - 1; }
+  inline bool empty() const { return size() == 0; }
+  inline size_t n_indexes() const { return indexes.size(); }
+
+  inline face_ref operator[](size_t f) {
+    return {indexes.data() + offsets[f], indexes.data() + offsets[f + 1]};
+  }
+  inline const_face_ref operator[](size_t f) const {
+    return {indexes.data() + offsets[f], indexes.data() + offsets[f + 1]};
+  }
+  inline face_ref back() { return (*this)[size() - 1]; }
+
+  iterator begin() { return {this, 0}; }
+  iterator end() { return {this, size()}; }
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, size()}; }
+
+  void push_back(const Face &face) {
+    indexes.insert(indexes.end(), face.begin(), face.end());
+    offsets.push_back(int(indexes.size()));
+  }
+  void reserve(size_t n_faces, size_t n_indexes) {
+    offsets.reserve(n_faces + 1);
+    indexes.reserve(n_indexes);
+  }
+  void clear() {
+    offsets.assign(1, 0);
+    indexes.clear();
+  }
+
+  size_t bytes() const {
+    return offsets.size() * sizeof(int) + indexes.size() * sizeof(int);
+  }
+
+  vector<int> offsets; // size()+1 entries, offsets[0]=0
+  vector<int> indexes; // vertex indexes of all faces
+
+private:
+  template <class It> static size_t count(It b, It e) {
+    size_t n = 0;
+    for (; b != e; ++b)
+      n += b->size();
+    return n;
+  }
+};
+
 class VertexIndex {
 public:
   int index;
@@ -125,99 +234,6 @@ public:
   inline bool operator!=(const Int4 &o) const { return !(*this == o); }
 };
 
-class MapIndex {
-public:
-  Int4 i0, i1, i2;
-
-  inline MapIndex(Int4 i0, Int4 i1, Int4 i2) {
-    this->i0 = i0;
-    this->i1 = i1;
-    this->i2 = i2;
-  }
-  inline MapIndex(Int4 i0, Int4 i1) { *this = MapIndex(i0, i1, 0); }
-  inline MapIndex(Int4 i0) { *this = MapIndex(i0, 0, 0); }
-  inline MapIndex() { *this = MapIndex(0, 0, 0); }
-
-  static inline bool less(const MapIndex &a, const MapIndex &b) {
-    return a < b;
-  }
-
-  inline bool operator<(const MapIndex &o) const {
-    if (i0 < o.i0)
-      return true;
-    if (i0 > o.i0)
-      return false;
-    if (i1 < o.i1)
-      return true;
-    if (i1 > o.i1)
-      return false;
-    if (i2 < o.i2)
-      return true;
-    return false; // i2>=o.i2
-  }
-
-  inline bool operator>(const MapIndex &o) const {
-    if (i0 > o.i0)
-      return true;
-    if (i0 < o.i0)
-      return false;
-    if (i1 > o.i1)
-      return true;
-    if (i1 < o.i1)
-      return false;
-    if (i2 > o.i2)
-      return true;
-    return false; // i2<=o.i2
-  }
-  inline const Int4 &operator[](int i) const { // accessor
-    switch (i) {
-    case 0:
-      return i0;
-    case 1:
-      return i1;
-    case 2:
-      return i2;
-    default:
-      return i0;
-    }
-  }
-  inline Int4 &operator[](int i) { // mutator
-    switch (i) {
-    case 0:
-      return i0;
-    case 1:
-      return i1;
-    case 2:
-      return i2;
-    default:
-      return i0;
-    }
-  }
-  inline bool operator==(const MapIndex &o) const {
-    return memcmp(this, &o, sizeof(MapIndex)) == 0;
-  }
-  inline bool operator!=(const MapIndex &o) const {
-    return memcmp(this, &o, sizeof(MapIndex)) != 0;
-  }
-};
-
-class I4Vix {
-public:
-  inline I4Vix() : index({}), vix({}) {}
-  inline I4Vix(Int4 index, VertexIndex vix) : index(index), vix(vix) {}
-
-  inline bool operator<(const I4Vix &o) { return index < o.index; }
-  static inline bool less(const I4Vix &a, const Int4 &index) {
-    return a.index < index;
-  }
-  inline bool operator==(const I4Vix &o) {
-    return memcmp(this, &o, sizeof(*this)) == 0;
-  }
-
-  Int4 index;
-  VertexIndex vix;
-};
-
 static inline Int4 to_int4(int v) { return {v + 1, 0, 0, 0}; }
 static inline Int4 to_int4(int v1, int v2) { return {v1 + 1, v2 + 1, 0, 0}; }
 static inline Int4 to_int4(int v1, int v2, int v3) {
@@ -240,6 +256,83 @@ static inline Int4 i4_min(int i, int v1, int v2) {
   return v1 < v2 ? i4(i, v1, v2) : i4(i, v2, v1);
 }
 
+// flag key names of vertexes and faces, packed in 64 bits:
+//   tag:4 | a:30 | b:30
+// a & b are stored +1, so an absent field is 0 and key(v) < key(v, w).
+// ordered, equal and hashed as a single uint64_t
+enum class Tag : uint64_t {
+  none, c, f, ex, fin, hex, cntr, dual, fdwn, orig, inner
+};
+
+class Key {
+public:
+  static const int field_bits = 30, tag_shift = 2 * field_bits;
+  static const uint64_t field_mask = (uint64_t(1) << field_bits) - 1;
+
+  uint64_t k = 0;
+
+  inline Key() {}
+  inline explicit Key(uint64_t k) : k(k) {}
+  inline Key(Tag tag, int a, int b = -1)
+      : k(uint64_t(tag) << tag_shift | uint64_t(a + 1) << field_bits |
+          uint64_t(b + 1)) {}
+
+  inline Tag tag() const { return Tag(k >> tag_shift); }
+  inline int a() const { return int((k >> field_bits) & field_mask) - 1; }
+  inline int b() const { return int(k & field_mask) - 1; }
+
+  inline bool operator<(const Key &o) const { return k < o.k; }
+  inline bool operator>(const Key &o) const { return k > o.k; }
+  inline bool operator==(const Key &o) const { return k == o.k; }
+  inline bool operator!=(const Key &o) const { return k != o.k; }
+
+  inline size_t hash() const { // splitmix64 finalizer
+    uint64_t h = k;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return size_t(h ^ (h >> 31));
+  }
+  struct Hash {
+    size_t operator()(const Key &k) const { return k.hash(); }
+  };
+};
+
+static inline Key key(int v) { return {Tag::none, v}; }
+static inline Key key(int v1, int v2) { return {Tag::none, v1, v2}; }
+static inline Key key(Tag tag, int v) { return {tag, v}; }
+static inline Key key(Tag tag, int v1, int v2) { return {tag, v1, v2}; }
+
+static inline Key key_min(int v1, int v2) {
+  return v1 < v2 ? key(v1, v2) : key(v2, v1);
+}
+static inline Key key_min(Tag tag, int v1, int v2) {
+  return v1 < v2 ? key(tag, v1, v2) : key(tag, v2, v1);
+}
+
+class MapKey { // flag: face, from -> to
+public:
+  Key face, from, to;
+
+  inline bool operator<(const MapKey &o) const {
+    return face != o.face ? face < o.face
+                          : from != o.from ? from < o.from : to < o.to;
+  }
+};
+
+class KeyIx { // vertex key & position of its coordinates (Flag::pts)
+public:
+  Key key;
+  uint32_t ix = 0;
+
+  inline KeyIx() {}
+  inline KeyIx(Key key, uint32_t ix) : key(key), ix(ix) {}
+
+  inline bool operator<(const KeyIx &o) const { return key < o.key; }
+  static inline bool less(const KeyIx &a, const Key &key) {
+    return a.key < key;
+  }
+};
+
 static string str(size_t i) { return to_string(i); }
 static string str(int i) { return to_string(i); }
 static inline string str(string s, size_t i) { return s + str(i); }
@@ -249,7 +342,7 @@ static inline string midName(int v1, int v2) {
 
 static Vertex calcCentroid(Vertexes vertices) {
   // running sum of vertex coords
-  Vertex centroidV = 0;
+  vec3 centroidV = 0;
   for (auto &v : vertices)
     centroidV += v;
   return centroidV / vertices.size();
@@ -258,11 +351,11 @@ static Vertex calcCentroid(Vertexes vertices) {
 static inline Vertex midpoint(Vertex vec1, Vertex vec2) {
   return (vec1 + vec2) / 2.;
 }
-static inline Vertex unit(Vertex v) { return simd::normalize(v); }
-static inline Vertex tween(Vertex &vec1, Vertex &vec2, float t) {
+static inline Vertex unit(Vertex v) { return vec::normalize(v); }
+static inline Vertex tween(const Vertex &vec1, const Vertex &vec2, float t) {
   return ((1.f - t) * vec1) + (t * vec2);
 }
-static inline Vertex oneThird(Vertex &vec1, Vertex &vec2) {
+static inline Vertex oneThird(const Vertex &vec1, const Vertex &vec2) {
   return tween(vec1, vec2, 1 / 3.f);
 }
 static inline int intersect(Face &set1, Face &set2, Face &set3) {
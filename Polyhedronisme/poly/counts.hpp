@@ -0,0 +1,176 @@
+//
+//  counts.hpp
+//  test_polygon
+//
+
+#ifndef counts_hpp
+#define counts_hpp
+
+#include "common.hpp"
+#include <map>
+#include <numeric>
+
+// closed form V, E, F of the operators, with the histograms of the face
+// and vertex degrees (f[k], v[k]: # of k-gons, of k-valent vertexes) the
+// parameterized ones need: kN, nN, xN, lN touch the N-gons only, u and G
+// the triangles only. exact on closed meshes; 'exact' drops when a count
+// depends on what is not known: the vertex degrees after a partial kN /
+// nN, anything on the open mesh of H but r, K, S
+struct Counts {
+  using Hist = std::map<int, long>;
+  static constexpr long limit = 1L << 40; // counts saturate: too big anyway
+
+  long V = 0, E = 0, F = 0;
+  Hist f, v;
+  bool faces_known = true, vertexes_known = true, closed = true,
+       exact = true;
+
+  template <class Poly> static Counts of(const Poly &p, bool closed) {
+    Counts c;
+    c.V = p.n_vertex, c.F = p.n_faces, c.E = p.faces.n_indexes() / 2;
+    vector<int> deg(p.n_vertex, 0); // faces around v: its degree if closed
+    for (auto i : p.faces.indexes)
+      deg[i]++;
+    for (auto d : deg)
+      c.v[d]++;
+    for (size_t i = 0; i < p.n_faces; i++)
+      c.f[p.faces[i].size()]++;
+    c.closed = c.exact = closed;
+    return c;
+  }
+
+  // op(n, m) of the parser: the counts after it
+  Counts apply(char op, int n = 0, int m = 0) const {
+    Counts c = *this;
+    if (!closed && !strchr("rKS", op))
+      c.exact = false;
+
+    switch (op) {
+    case 'd':
+      std::swap(c.V, c.F), std::swap(c.f, c.v);
+      std::swap(c.faces_known, c.vertexes_known);
+      break;
+    case 'a':
+      c.V = E, c.F = F + V, c.E = 2 * E;
+      c.v = {{4, E}}, c.f = sum(f, v);
+      c.faces_known = faces_known && vertexes_known, c.vertexes_known = true;
+      break;
+    case 'k': {
+      long fn = n ? count(f, n) : F, hn = n ? mul(n, fn) : 2 * E; // N-gons
+      c.V = V + fn, c.F = F - fn + hn, c.E = E + hn;
+      c.f = n ? sum(without(f, n), {{3, hn}}) : Hist{{3, 2 * E}};
+      c.v = sum(fn == F ? twice(v) : v, n ? Hist{{n, fn}} : f);
+      c.vertexes_known = vertexes_known && (fn == F || fn == 0) &&
+                         (n || faces_known);
+      depends_on_faces(c, n);
+      break;
+    }
+    case 'g':
+      c.V = V + 2 * E + F, c.F = 2 * E, c.E = 5 * E;
+      c.v = sum(sum(v, f), {{3, 2 * E}}), c.f = {{5, 2 * E}};
+      c.vertexes_known = vertexes_known && faces_known, c.faces_known = true;
+      break;
+    case 'p':
+      c.V = V + 2 * E, c.F = F + 2 * E, c.E = 5 * E;
+      c.v = sum(v, {{4, 2 * E}}), c.f = sum(f, {{4, 2 * E}});
+      break;
+    case 'P':
+      c.V = V + 2 * E, c.F = F + 4 * E, c.E = 7 * E;
+      c.v = sum(twice(v), {{5, 2 * E}}), c.f = sum(f, {{3, 4 * E}});
+      break;
+    case 'q':
+      c.V = V + 3 * E, c.F = F + 2 * E, c.E = 6 * E;
+      c.v = sum(v, {{4, E}, {3, 2 * E}}), c.f = sum(f, {{5, 2 * E}});
+      break;
+    case 'c':
+      c.V = V + 2 * E, c.F = F + E, c.E = 4 * E;
+      c.v = sum(v, {{3, 2 * E}}), c.f = sum(f, {{6, E}});
+      break;
+    case 'w':
+      c.V = V + 4 * E, c.F = F + 2 * E, c.E = 7 * E;
+      c.v = sum(v, {{3, 4 * E}}), c.f = sum(f, {{6, 2 * E}});
+      break;
+    case 'n':
+    case 'x':
+    case 'l': {
+      long fn = n ? count(f, n) : F, hn = n ? mul(n, fn) : 2 * E; // N-gons
+      c.V = V + hn, c.F = F + hn, c.E = E + 2 * hn;
+      c.v = sum(fn == F ? twice(v) : v, {{3, hn}}), c.f = sum(f, {{4, hn}});
+      c.vertexes_known = vertexes_known && (fn == F || fn == 0);
+      depends_on_faces(c, n);
+      break;
+    }
+    case 'H':
+      c.V = V + 4 * E, c.F = 4 * E, c.E = 8 * E;
+      c.v = sum(twice(v), {{3, 2 * E}, {4, 2 * E}}), c.f = {{4, 4 * E}};
+      c.vertexes_known = vertexes_known, c.faces_known = true;
+      c.closed = false;
+      break;
+    case 'u':
+    case 'G': {
+      long a = op == 'u' ? (n ? std::max(n, 1) : 2) : (n || m ? n : 1),
+           b = op == 'u' ? 0 : m;
+      if (!faces_known)
+        c.exact = false; // as if all triangles
+      else if (count(f, 3) != F || (a && b && !closed) || a + b == 0)
+        break; // no-op
+      a = std::min(a, limit), b = std::min(b, limit);
+      long T = mul(a, a + b) + mul(b, b), g = std::gcd(a, b);
+      long inner = T == limit ? limit : (T - 3 * g) / 2 + 1; // Pick
+      long nv = mul(E, g - 1) + mul(F, inner);
+      c.V = V + nv, c.F = mul(F, T), c.E = mul(E, T);
+      c.v = sum(v, {{6, nv}}), c.f = {{3, c.F}};
+      break;
+    }
+    }
+    c.saturate();
+    return c;
+  }
+
+  // the Polyhedron after recalc, its half-edges built
+  size_t bytes() const {
+    size_t ints = (F + 1) + 2 * E;
+    return V * sizeof(Vertex) + F * (3 * sizeof(Vertex) + sizeof(float)) +
+           ints * sizeof(int) +
+           (3 * 2 * E + V + 1 + ints) * sizeof(int); // half-edges
+  }
+
+private:
+  static long mul(long a, long b) {
+    return a && b > limit / a ? limit : std::min(a * b, limit);
+  }
+  void saturate() {
+    for (auto x : {&V, &E, &F})
+      *x = std::min(*x, limit);
+    for (auto h : {&f, &v})
+      for (auto &kv : *h)
+        kv.second = std::min(kv.second, limit);
+  }
+  static long count(const Hist &h, int k) {
+    auto it = h.find(k);
+    return it == h.end() ? 0 : it->second;
+  }
+  static Hist sum(Hist a, const Hist &b) {
+    for (auto &kv : b)
+      if (kv.second)
+        a[kv.first] += kv.second;
+    return a;
+  }
+  static Hist without(Hist h, int k) {
+    h.erase(k);
+    return h;
+  }
+  static Hist twice(const Hist &h) { // degrees doubled
+    Hist t;
+    for (auto &kv : h)
+      t[2 * kv.first] = kv.second;
+    return t;
+  }
+  // kN, nN... count the N-gons: unknown faces, unknown counts
+  void depends_on_faces(Counts &c, int n) const {
+    if (n && !faces_known)
+      c.exact = false;
+  }
+};
+
+#endif /* counts_hpp */
@@ -0,0 +1,271 @@
+//
+//  face_kernels.hpp
+//  test_polygon
+//
+
+#ifndef face_kernels_hpp
+#define face_kernels_hpp
+
+#include "Thread.h"
+#include "common.hpp"
+
+#if defined(__AVX2__) && defined(__FMA__) // -mavx2 -mfma: always
+#define FACE_KERNELS_AVX2
+#define FACE_KERNELS_TARGET
+#include <immintrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FACE_KERNELS_AVX2 // other x86 gcc / clang builds: if the cpu has it
+#define FACE_KERNELS_DISPATCH
+#define FACE_KERNELS_TARGET __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+#endif
+
+// batched face normals, centers & areas (avx2 + fma builds), 8 faces of the
+// same size 3..max_size per kernel: their vertexes loaded & transposed to
+// x[], y[], z[] registers, fma cross products, rsqrt + newton normalize.
+// runs of 8 consecutive faces of one size (all of k, g, trisub output) go as
+// they are, the other faces are bucketed by size; larger faces and the < 8
+// rest of each bucket go to general(f). a normal only needs the first 3
+// vertexes: any size. x86 builds without -mavx2 compile the kernels for
+// avx2 + fma apart and enable them on cpus that have both; other builds
+// (arm, msvc), or enabled=false: general(f) for all
+class FaceKernels {
+public:
+#if defined(FACE_KERNELS_DISPATCH)
+  static inline bool enabled =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(FACE_KERNELS_AVX2)
+  static inline bool enabled = true;
+#else
+  static inline bool enabled = false;
+#endif
+  static const int lanes = 8, max_size = 5;
+
+  // normals, centers, areas: nullptr -> not computed
+  template <class General>
+  static void run([[maybe_unused]] const Vertexes &vertexes,
+                  const Faces &faces, [[maybe_unused]] Vertex *normals,
+                  [[maybe_unused]] Vertex *centers,
+                  [[maybe_unused]] float *areas, General general) {
+#ifdef FACE_KERNELS_AVX2
+    if (enabled) {
+      bool normals_only = !centers && !areas;
+      int nc = faces.size() / lanes;
+      auto xyz = reinterpret_cast<const float *>(vertexes.data());
+      Out out{normals, centers, areas};
+
+      vector<char> runs(nc); // size of faces 8c..8c+7, 0: mixed
+      Thread(nc).run([xyz, &faces, &runs, normals_only, out](int c) {
+        int fs[lanes], s = size(faces, c * lanes, normals_only);
+        for (int l = 0; l < lanes; l++) {
+          fs[l] = c * lanes + l;
+          if (size(faces, fs[l], normals_only) != s)
+            s = 0;
+        }
+        switch (runs[c] = s >= 3 && s <= max_size ? s : 0) {
+        case 3: batch<3>(xyz, faces, fs, out, true); break;
+        case 4: batch<4>(xyz, faces, fs, out, true); break;
+        case 5: batch<5>(xyz, faces, fs, out, true); break;
+        }
+      });
+
+      vector<int> buckets[max_size + 1]; // [3..max_size], [0]: general
+      bucket(faces, runs, normals_only, buckets);
+      batches<3>(xyz, faces, buckets[3], out);
+      batches<4>(xyz, faces, buckets[4], out);
+      batches<5>(xyz, faces, buckets[5], out);
+
+      auto &rest = buckets[0];
+      Thread(rest.size()).run([&rest, &general](int i) { general(rest[i]); });
+      return;
+    }
+#endif
+    Thread(faces.size()).run([&general](int f) { general(f); });
+  }
+
+#ifdef FACE_KERNELS_AVX2
+private:
+  struct Out {
+    Vertex *normals, *centers;
+    float *areas;
+  };
+
+  static inline int size(const Faces &faces, int f, bool normals_only) {
+    int s = faces.offsets[f + 1] - faces.offsets[f];
+    return normals_only && s > 3 ? 3 : s;
+  }
+
+  // faces outside the runs: of size s -> buckets[s] in whole batches of
+  // lanes, the others (large faces, rests) -> buckets[0]
+  static void bucket(const Faces &faces, const vector<char> &runs,
+                     bool normals_only, vector<int> *buckets) {
+    int nf = faces.size(), count[max_size + 1] = {0};
+    auto mixed = [&runs, nf](auto fn) { // fn(f) of the faces, run chunks out
+      for (int c = 0; c * lanes < nf; c++)
+        if (c >= int(runs.size()) || !runs[c])
+          for (int f = c * lanes; f < std::min(nf, (c + 1) * lanes); f++)
+            fn(f);
+    };
+    mixed([&](int f) {
+      int s = size(faces, f, normals_only);
+      count[s <= max_size ? s : 0]++;
+    });
+    for (int s = 3; s <= max_size; s++) {
+      count[0] += count[s] % lanes;
+      count[s] -= count[s] % lanes;
+    }
+    count[0] += count[1] + count[2];
+    for (int s = 0; s <= max_size; s++)
+      buckets[s].reserve(count[s]);
+    mixed([&](int f) {
+      int s = size(faces, f, normals_only);
+      auto &b = s >= 3 && s <= max_size && int(buckets[s].size()) < count[s]
+                    ? buckets[s]
+                    : buckets[0];
+      b.push_back(f);
+    });
+  }
+
+  template <int K>
+  static void batches(const float *xyz, const Faces &faces,
+                      const vector<int> &fs, Out out) {
+    Thread(fs.size() / lanes).run([xyz, &faces, &fs, out](int b) {
+      batch<K>(xyz, faces, fs.data() + b * lanes, out, false);
+    });
+  }
+
+  // 8 faces, their first K vertexes. consecutive: fs[l] = fs[0] + l
+  template <int K>
+  FACE_KERNELS_TARGET static inline void
+  batch(const float *xyz, const Faces &faces, const int *fs, Out out,
+        bool consecutive) {
+    __m256 x[K], y[K], z[K];
+    const int *ix[lanes]; // vertex indexes of each face
+#pragma GCC unroll 8
+    for (int l = 0; l < lanes; l++)
+      ix[l] = faces.indexes.data() + faces.offsets[fs[l]];
+#pragma GCC unroll 8
+    for (int j = 0; j < K; j++) { // lanes l & l+4 -> transposed
+      __m256 r[4];
+#pragma GCC unroll 4
+      for (int l = 0; l < 4; l++)
+        r[l] = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(load(xyz, ix[l][j])),
+            load(xyz, ix[l + 4][j]), 1);
+      __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), // x0 x1 y0 y1
+          t1 = _mm256_unpackhi_ps(r[0], r[1]),    // z0 z1 .. ..
+          t2 = _mm256_unpacklo_ps(r[2], r[3]),    // x2 x3 y2 y3
+          t3 = _mm256_unpackhi_ps(r[2], r[3]);    // z2 z3 .. ..
+      x[j] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+      y[j] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+      z[j] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    }
+
+    // normal: unit(cross(v1 - v0, v2 - v1))
+    __m256 ax = _mm256_sub_ps(x[1], x[0]), ay = _mm256_sub_ps(y[1], y[0]),
+           az = _mm256_sub_ps(z[1], z[0]), bx = _mm256_sub_ps(x[2], x[1]),
+           by = _mm256_sub_ps(y[2], y[1]), bz = _mm256_sub_ps(z[2], z[1]);
+    __m256 nx = _mm256_fmsub_ps(ay, bz, _mm256_mul_ps(az, by)),
+           ny = _mm256_fmsub_ps(az, bx, _mm256_mul_ps(ax, bz)),
+           nz = _mm256_fmsub_ps(ax, by, _mm256_mul_ps(ay, bx));
+    __m256 l2 = _mm256_fmadd_ps(
+               nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz))),
+           r = _mm256_rsqrt_ps(l2); // r *= 1.5 - l2 / 2 * r * r
+    r = _mm256_mul_ps(
+        r, _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_mul_ps(l2, r), r),
+                            _mm256_set1_ps(0.5f), _mm256_set1_ps(1.5f)));
+    nx = _mm256_mul_ps(nx, r), ny = _mm256_mul_ps(ny, r),
+    nz = _mm256_mul_ps(nz, r);
+
+    if (out.normals)
+      store(out.normals, fs, consecutive, nx, ny, nz);
+
+    if (out.centers) { // sum / K
+      __m256 cx = x[0], cy = y[0], cz = z[0], k = _mm256_set1_ps(K);
+#pragma GCC unroll 8
+      for (int j = 1; j < K; j++)
+        cx = _mm256_add_ps(cx, x[j]), cy = _mm256_add_ps(cy, y[j]),
+        cz = _mm256_add_ps(cz, z[j]);
+      store(out.centers, fs, consecutive, _mm256_div_ps(cx, k),
+            _mm256_div_ps(cy, k), _mm256_div_ps(cz, k));
+    }
+
+    if (out.areas) { // |normal . sum of cross(v_i, v_i+1)| / 2
+      __m256 sx = _mm256_setzero_ps(), sy = sx, sz = sx;
+#pragma GCC unroll 8
+      for (int j = 0, i = K - 1; j < K; i = j++) {
+        sx = _mm256_add_ps(sx, _mm256_fmsub_ps(y[i], z[j],
+                                               _mm256_mul_ps(z[i], y[j])));
+        sy = _mm256_add_ps(sy, _mm256_fmsub_ps(z[i], x[j],
+                                               _mm256_mul_ps(x[i], z[j])));
+        sz = _mm256_add_ps(sz, _mm256_fmsub_ps(x[i], y[j],
+                                               _mm256_mul_ps(y[i], x[j])));
+      }
+      __m256 d = _mm256_fmadd_ps(
+          nx, sx, _mm256_fmadd_ps(ny, sy, _mm256_mul_ps(nz, sz)));
+      d = _mm256_andnot_ps(_mm256_set1_ps(-0.f), d); // abs
+      d = _mm256_mul_ps(d, _mm256_set1_ps(0.5f));
+      if (consecutive)
+        _mm256_storeu_ps(out.areas + fs[0], d);
+      else {
+        alignas(32) float a[lanes];
+        _mm256_store_ps(a, d);
+        for (int l = 0; l < lanes; l++)
+          out.areas[fs[l]] = a[l];
+      }
+    }
+  }
+
+  // x y z 0 of vertex v: 8 (unaligned) + 4 byte loads, none past the end
+  // of xyz
+  FACE_KERNELS_TARGET static inline __m128 load(const float *xyz, int v) {
+    const float *p = xyz + 3 * v;
+    return _mm_movelh_ps(
+        _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)p)),
+        _mm_load_ss(p + 2));
+  }
+
+  // x[], y[], z[] -> to[fs[l]]
+  FACE_KERNELS_TARGET static inline void
+  store(Vertex *to, const int *fs, bool consecutive, __m256 x, __m256 y,
+        __m256 z) {
+    if (consecutive) { // 4 + 4 packed xyz: 6 x 16 bytes
+      auto p = reinterpret_cast<float *>(to + fs[0]);
+      store4(p, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+             _mm256_castps256_ps128(z));
+      store4(p + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+             _mm256_extractf128_ps(z, 1));
+      return;
+    }
+    __m256 lo = _mm256_unpacklo_ps(x, y), // x0 y0 x1 y1 | x4 y4 x5 y5
+        hi = _mm256_unpackhi_ps(x, y);    // x2 y2 x3 y3 | x6 y6 x7 y7
+    __m128 xy[4] = {_mm256_castps256_ps128(lo), _mm256_castps256_ps128(hi),
+                    _mm256_extractf128_ps(lo, 1),
+                    _mm256_extractf128_ps(hi, 1)};
+    alignas(32) float zs[lanes];
+    _mm256_store_ps(zs, z);
+#pragma GCC unroll 4
+    for (int l = 0; l < lanes; l += 2) { // x y as 8 bytes, z
+      __m128 m = xy[l / 2];
+      _mm_storel_pi((__m64 *)&to[fs[l]].x, m);
+      _mm_storeh_pi((__m64 *)&to[fs[l + 1]].x, m);
+      to[fs[l]].z = zs[l], to[fs[l + 1]].z = zs[l + 1];
+    }
+  }
+
+  // x0..3, y0..3, z0..3 -> x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+  FACE_KERNELS_TARGET static inline void store4(float *p, __m128 x, __m128 y,
+                                                __m128 z) {
+    __m128 t0 = _mm_unpacklo_ps(x, y), // x0 y0 x1 y1
+        t1 = _mm_unpackhi_ps(x, y),    // x2 y2 x3 y3
+        u = _mm_shuffle_ps(z, t0, _MM_SHUFFLE(2, 2, 0, 0)), // z0 z0 x1 x1
+        v = _mm_shuffle_ps(t0, z, _MM_SHUFFLE(1, 1, 3, 3)), // y1 y1 z1 z1
+        w = _mm_shuffle_ps(z, t1, _MM_SHUFFLE(3, 2, 3, 2)); // z2 z3 x3 y3
+    _mm_storeu_ps(p, _mm_shuffle_ps(t0, u, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(p + 4, _mm_shuffle_ps(v, t1, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(p + 8, _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 3, 2, 0)));
+  }
+#endif
+};
+
+#endif /* face_kernels_hpp */
@@ -4,72 +4,178 @@
 #include "common.hpp"
 #include "polyhedron.hpp"
 
+// emission filter: open addressing table of the keys already seen, so
+// repeats are dropped before they are sorted. lossy: it grows up to
+// 2^max_bits slots, then a full probe window replaces its home slot, and
+// what slips through is removed by the sort anyway. turns itself off when
+// less than 1/8 of the first 'sample' keys were repeats
+class KeyFilter {
+public:
+  static inline int max_bits = 16; // max 64k slots, 512kb
+  static const int probes = 8, sample = 4096;
+
+  size_t n_added = 0, n_dropped = 0;
+
+  inline bool repeat(Key key) { // true: drop key
+    if (!on)
+      return false;
+    if (seen(key)) {
+      n_dropped++;
+      return true;
+    }
+    if (++n_added == sample && n_dropped < sample / 8) {
+      on = false;
+      table = vector<uint64_t>();
+    }
+    return false;
+  }
+
+private:
+  vector<uint64_t> table; // key.k, 0: empty (no key packs to 0)
+  size_t n_table = 0;
+  bool on = true;
+
+  bool seen(Key key) { // lookup, insert if not found
+    if (n_table * 2 >= table.size() && table.size() < (1u << max_bits))
+      grow();
+
+    size_t mask = table.size() - 1, h = key.hash() & mask;
+    for (int p = 0; p < probes; p++) {
+      uint64_t &slot = table[(h + p) & mask];
+      if (slot == key.k)
+        return true;
+      if (slot == 0) {
+        slot = key.k, n_table++;
+        return false;
+      }
+    }
+    table[h] = key.k; // window full: replace the home slot
+    return false;
+  }
+
+  void grow() { // x4, rehash
+    vector<uint64_t> old(table.empty() ? 256 : table.size() * 4, 0);
+    old.swap(table);
+    n_table = 0;
+    for (auto k : old)
+      if (k)
+        seen(Key(k));
+  }
+};
+
+// operators build a flag in two phases: count the keys each source face
+// emits, prefix sum them (alloc) and fill the exact slots of every face in
+// parallel (slots(f)), then combine() sorts & merges them into vertexes and
+// faces
 class Flag {
 public:
   Vertexes vertexes;
   Faces faces;
 
-  vector<I4Vix> v;
-  vector<MapIndex> m; // m[i4][i4]=i4 -> m[]<<i4,i4,i4
-  vector<vector<Int4>> fcs;
+  // vertex keys are sorted apart from their coordinates: v holds the key and
+  // the position of its coordinates in pts, which are gathered into
+  // 'vertexes' once v is sorted & unique (index_vertexes)
+  vector<KeyIx> v;
+  Vertexes pts;
+  vector<MapKey> m; // m[face][from]=to -> m[]<<face,from,to
+  vector<Key> fc_keys; // faces given by their vertex keys:
+  vector<int> fc_offsets{0}; // fc_keys[fc_offsets[i]..fc_offsets[i+1])
 
-  int v_index = 0; // index of last added vertex (add_vertex)
+  static inline bool use_filter = true; // KeyFilter in index_vertexes
 
   Flag() = default;
-  Flag(vector<Flag> &flags) { // consolidate flags -> flag
-    combine(flags);
-  }
+  Flag(Vertexes &vertexes) { set_vertexes(vertexes); }
+
+  struct Count { // emitted by one face: vertexes, flags, fc faces & keys
+    int v = 0, m = 0, fcs = 0, fc_keys = 0;
+  };
+
+  // per face counts -> prefix sums -> allocate all slots once, after what
+  // the flag already holds (i.e. set_vertexes)
+  void alloc(int n_faces, std::function<Count(int)> const &count) {
+    at.resize(n_faces + 1);
+    at[0] = {int(v.size()), int(m.size()), int(fc_offsets.size()) - 1,
+             int(fc_keys.size())};
+    Thread(n_faces).run([this, &count](int f) { at[f + 1] = count(f); });
+
+    for (int f = 0; f < n_faces; f++) {
+      auto &a = at[f], &b = at[f + 1];
+      b = {a.v + b.v, a.m + b.m, a.fcs + b.fcs, a.fc_keys + b.fc_keys};
+    }
 
-  Flag(Vertexes &vertexes) { // consolidate flags -> flag
-    set_vertexes(vertexes);
+    auto &tot = at[n_faces];
+    v.resize(tot.v);
+    pts.resize(tot.v);
+    m.resize(tot.m);
+    fc_offsets.resize(tot.fcs + 1);
+    fc_keys.resize(tot.fc_keys);
   }
 
-  void combine(vector<Flag> &flags) { // combine flags(v,m,fcs) -> flag
+  class Slots { // write cursor of one face in the allocated slots
+  public:
+    inline Slots(Flag &flag, Count at) : flag(flag), at(at) {}
 
-    // totalize v, fcs -> calc offsets
-    int vs = v.size(), v_tot = vs, f_tot = 0,
-        m_tot = 0; // v may contain vertex
-    vector<int> v_offsets{0}, fcs_offsets{0}, m_offsets{0};
+    inline void add_vertex(Key key, Vertex vtx) {
+      flag.v[at.v] = {key, uint32_t(at.v)};
+      flag.pts[at.v++] = vtx;
+    }
+    inline void add_face(Key face, Key from, Key to) {
+      flag.m[at.m++] = {face, from, to};
+    }
+    inline void add_face(std::initializer_list<Key> keys) {
+      add_face(keys.begin(), keys.end());
+    }
+    inline void add_face(vector<Key> const &keys) {
+      add_face(keys.data(), keys.data() + keys.size());
+    }
 
-    v_offsets[0] = vs;
+  private:
+    Flag &flag;
+    Count at;
 
-    for (auto &f : flags) {
-      v_offsets.push_back(v_tot += f.v.size());
-      fcs_offsets.push_back(f_tot += f.fcs.size());
-      m_offsets.push_back(m_tot += f.m.size());
+    inline void add_face(const Key *b, const Key *e) {
+      at.fc_keys = int(std::copy(b, e, &flag.fc_keys[at.fc_keys]) -
+                       flag.fc_keys.data());
+      flag.fc_offsets[++at.fcs] = at.fc_keys;
     }
+  };
 
-    // resize v,m to total required space
-    v.resize(v_tot + v.size());
-    m.resize(m_tot);
+  inline Slots slots(int f) { return {*this, at[f]}; }
 
-    // copy threaded flag.v,m,fcs << flags[].v,m,fcs
-    Thread(flags.size())
-        .run([this, &flags, &v_offsets,
-              &m_offsets](int nflag) { // combine (v,m) flags[] -> flag
-          copy(flags[nflag].v.begin(), flags[nflag].v.end(),
-               &v[v_offsets[nflag]]);
-          copy(flags[nflag].m.begin(), flags[nflag].m.end(),
-               &m[m_offsets[nflag]]);
-        });
+  void combine() { // v, m, fc -> vertexes, faces
+    last_v = v.size(), last_m = m.size(), last_fcs = fc_keys.size();
 
     index_vertexes(); // numerate 'v', v->vertexes
+    sort_m();
 
-    process_m(); // faces << m
+    // faces << m, fc: sizes of all faces first, allocate once, then fill
+    auto ft = from_to_m();
+    auto sizes = m_face_sizes(ft);
+    int fs_m = sizes.size(), n_fc = fc_offsets.size() - 1;
+    sizes.resize(fs_m + n_fc);
+    for (int i = 0; i < n_fc; i++)
+      sizes[fs_m + i] = fc_offsets[i + 1] - fc_offsets[i];
 
-    // faces << fcs
-    int fs_m = faces.size();
-    faces.resize(f_tot + fs_m);
+    faces = Faces(sizes);
 
-    Thread(flags.size()).run([this, &flags, &fcs_offsets, fs_m](int t) {
-      int offset = fcs_offsets[t] + fs_m;
-      for (auto &fc : flags[t].fcs) {
-        Face face;
-        for (auto &vix : fc)
-          face.push_back(find_vertex_index(vix));
-        faces[offset++] = face;
-      }
+    auto len = fill_m_faces(ft);
+
+    Thread(n_fc).run([this, fs_m](int i) {
+      auto face = faces[fs_m + i];
+      for (int j = 0, b = fc_offsets[i]; j < int(face.size()); j++)
+        face[j] = find_vertex_index(fc_keys[b + j]);
     });
+
+    cut_faces(len);
+  }
+
+  // # of keys in v, m, fc of the last combine, for memory accounting
+  static inline size_t last_v = 0, last_m = 0, last_fcs = 0;
+  static inline size_t last_dropped = 0; // repeats filtered out
+
+  static size_t bytes(size_t nv, size_t nm, size_t nfcs) { // + pts
+    return nv * (sizeof(KeyIx) + sizeof(Vertex)) + nm * sizeof(MapKey) +
+           nfcs * sizeof(Key);
   }
 
   inline int add_vertex(Vertex v) {
@@ -77,18 +183,143 @@ public:
     return vertexes.size() - 1;
   }
 
-  void sort_unique_v() { // fastest solution
-    sort(v.begin(), v.end(), [](I4Vix &a, I4Vix &b) -> bool { return a < b; });
+  static inline bool use_radix = true; // false: std::sort fallback
+  // accumulated sort_unique & index (filter, sort, merge, gather) times
+  static inline std::atomic<long> sort_ns{0}, sort_n{0}, index_ns{0};
+
+  // b[0..n) sorted by key, unique keys (first one kept), returns new n
+  static int sort_unique(KeyIx *b, int n) {
+    using clock = std::chrono::high_resolution_clock;
+    auto t0 = clock::now();
+    sort_n += n;
+
+    if (use_radix && n >= radix_min)
+      n = radix_sort_unique(b, n);
+    else
+      n = std_sort_unique(b, n);
+
+    sort_ns += long(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - t0)
+                        .count());
+    return n;
+  }
 
-    const auto &it = unique(v.begin(), v.end(),
-                            [](I4Vix &a, I4Vix &b) -> bool { return a == b; });
-    v.resize(std::distance(v.begin(), it));
-    // unique ordered set of vectors
-    //    v.erase(
-    //        unique(v.begin(), v.end(),
-    //               [](I4Vix &a, I4Vix &b) -> bool { return a.first == b.first;
-    //               }),
-    //        v.end());
+  static int std_sort_unique(KeyIx *b, int n) {
+    std::stable_sort(b, b + n);
+    return int(std::unique(b, b + n, [](KeyIx &x, KeyIx &y) {
+                 return x.key == y.key;
+               }) -
+               b);
+  }
+
+  // parallel lsd radix sort of b. each key field (tag, a, b) is rebased to
+  // its min and the used bit widths are concatenated into the radix key
+  // (i.e. an unused b takes no bits), whose 11 bit digits are taken on the
+  // fly while the 16 byte KeyIx are scattered. the unique pass is fused in
+  // the last copy (unique = false: all kept, a stable sort)
+  static const int radix_min = 1 << 12;
+  static const int radix_bits = 11, radix_size = 1 << radix_bits;
+
+  static int radix_sort_unique(KeyIx *b, int n, bool unique = true) {
+    static const int nf = 3, f_shift[nf] = {Key::tag_shift, Key::field_bits, 0};
+    static const uint64_t f_mask[nf] = {0xf, Key::field_mask, Key::field_mask};
+    auto field = [](uint64_t k, int j) {
+      return (k >> f_shift[j]) & f_mask[j];
+    };
+
+    Thread th(n);
+    int nth = th.nth;
+
+    // per field range
+    vector<uint64_t> mins(nth * nf, UINT64_MAX), maxs(nth * nf, 0);
+    th.run([b, &mins, &maxs, field](int t, int from, int to) {
+      uint64_t *mn = &mins[t * nf], *mx = &maxs[t * nf];
+      for (int i = from; i < to; i++)
+        for (int j = 0; j < nf; j++) {
+          mn[j] = std::min(mn[j], field(b[i].key.k, j));
+          mx[j] = std::max(mx[j], field(b[i].key.k, j));
+        }
+    });
+
+    uint64_t base[nf];
+    int shift[nf], total_bits = 0;
+    for (int j = nf - 1; j >= 0; j--) {
+      uint64_t mn = UINT64_MAX, mx = 0;
+      for (int t = 0; t < nth; t++) {
+        mn = std::min(mn, mins[t * nf + j]);
+        mx = std::max(mx, maxs[t * nf + j]);
+      }
+      int bits = 0;
+      for (uint64_t range = mx - mn; range; range >>= 1)
+        bits++;
+      base[j] = mn;
+      shift[j] = total_bits;
+      total_bits += bits;
+    }
+
+    auto radix_key = [&base, &shift, field](Key key) {
+      uint64_t rk = 0;
+      for (int j = 0; j < nf; j++)
+        rk |= (field(key.k, j) - base[j]) << shift[j];
+      return rk;
+    };
+
+    vector<KeyIx> tmp(n);
+    KeyIx *src = b, *dst = tmp.data(); // ping pong
+    vector<int> hist(nth * radix_size);
+    for (int sh = 0; sh < total_bits; sh += radix_bits) {
+      auto digit = [radix_key, sh](Key key) {
+        return (radix_key(key) >> sh) & (radix_size - 1);
+      };
+
+      std::fill(hist.begin(), hist.end(), 0);
+      th.run([src, &hist, digit](int t, int from, int to) {
+        int *h = &hist[t * radix_size];
+        for (int i = from; i < to; i++)
+          h[digit(src[i].key)]++;
+      });
+
+      // offsets: digit major, thread minor -> stable
+      for (int d = 0, sum = 0; d < radix_size; d++)
+        for (int t = 0; t < nth; t++) {
+          int c = hist[t * radix_size + d];
+          hist[t * radix_size + d] = sum;
+          sum += c;
+        }
+
+      th.run([src, dst, &hist, digit](int t, int from, int to) {
+        int *h = &hist[t * radix_size];
+        for (int i = from; i < to; i++)
+          dst[h[digit(src[i].key)]++] = src[i];
+      });
+      std::swap(src, dst);
+    }
+
+    // fused unique: heads per segment, prefix, write src -> dst (-> b)
+    vector<int> heads(nth + 1, 0);
+    auto head = [src, unique](int i) {
+      return !unique || i == 0 || src[i].key != src[i - 1].key;
+    };
+    th.run([&heads, head](int t, int from, int to) {
+      int c = 0;
+      for (int i = from; i < to; i++)
+        c += head(i);
+      heads[t + 1] = c;
+    });
+    for (int t = 0; t < nth; t++)
+      heads[t + 1] += heads[t];
+
+    th.run([src, dst, &heads, head](int t, int from, int to) {
+      int j = heads[t];
+      for (int i = from; i < to; i++)
+        if (head(i))
+          dst[j++] = src[i];
+    });
+    if (dst != b)
+      Thread(heads[nth]).run([b, dst](int, int from, int to) {
+        copy(dst + from, dst + to, b + from);
+      });
+    return heads[nth];
   }
 
   //  void sort_unique_v_unsortedsets() {
@@ -123,60 +354,197 @@ public:
   //    v.assign(s.begin(), s.end());
   //  }
 
-  void index_vertexes() { // v, numerate vertexes index & create vertexes[]
-    sort_unique_v();
-    vertexes.resize(v.size()); // numerate & create vertexes[]
+  // v is cut in one segment per slot, each one filtered (optional), sorted &
+  // unique on its own, then merged: vertex index = position in v, gather
+  // vertexes[]
+  void index_vertexes() {
+    using clock = std::chrono::high_resolution_clock;
+    auto t0 = clock::now();
+
+    int n = v.size();
+    Thread th(n);
+    vector<Run<KeyIx>> runs(th.nth);
+    std::atomic<long> dropped{0};
+
+    th.run([this, &runs, &dropped](int t, int from, int to) {
+      int e = to;
+      if (use_filter) {
+        KeyFilter filter;
+        e = from;
+        for (int i = from; i < to; i++)
+          if (!filter.repeat(v[i].key))
+            v[e++] = v[i];
+        dropped += filter.n_dropped;
+      }
+      runs[t] = {v.data() + from, sort_unique(v.data() + from, e - from)};
+    });
+    last_dropped = dropped;
+
+    vector<KeyIx> vm;
+    merge_runs(runs, vm, true,
+               [](int, const KeyIx &x) -> const KeyIx & { return x; });
+    v.swap(vm);
+
+    gather_vertexes();
+
+    index_ns += long(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         clock::now() - t0)
+                         .count());
+  }
 
-    Thread(v.size()).run([this](int i) {
-      VertexIndex &_v = v[i].vix; // <index, vertex>
-      _v.index = i;
-      vertexes[i] = _v.vertex;
+  void gather_vertexes() { // vertexes[i] = pts[v[i].ix]
+    vertexes.resize(v.size());
+    Thread(v.size()).run([this](int i) { vertexes[i] = pts[v[i].ix]; });
+    pts = Vertexes();
+  }
+
+  template <class T> struct Run { // sorted run: a segment of v or m
+    const T *b;
+    int n;
+  };
+
+  // parallel k-way merge of sorted runs into out. the output is split in
+  // partitions by splitters sampled from the runs and each run is cut at them
+  // by lower_bound, so equal elements always meet in the same partition. each
+  // partition merges its part of the runs with a heap of run heads (ties: the
+  // lower run first) and, if 'unique', drops repeats in stream. emit(r, x)
+  // writes x of run r, i.e. rebased, keeping its order
+  static const long merge_min = 1 << 12; // below: a single partition
+
+  template <class T, class Emit>
+  static void merge_runs(vector<Run<T>> const &runs, vector<T> &out,
+                         bool unique, Emit emit) {
+    int k = runs.size();
+    long total = 0;
+    for (auto &r : runs)
+      total += r.n;
+    out.clear();
+    if (total == 0)
+      return;
+
+    Thread th(total < merge_min ? 1 : total);
+    int np = th.nth;
+
+    vector<T> samples; // np x 4 per run
+    for (auto &r : runs)
+      for (int s = 1, ns = np * 4; r.n && s <= ns; s++)
+        samples.push_back(r.b[long(r.n) * s / (ns + 1)]);
+    std::sort(samples.begin(), samples.end());
+
+    vector<int> cut((np + 1) * k); // cut[p * k + r]: partition p in run r
+    for (int r = 0; r < k; r++)
+      cut[r] = 0, cut[np * k + r] = runs[r].n;
+    for (int p = 1; p < np; p++) {
+      const T &sp = samples[samples.size() * p / np];
+      for (int r = 0; r < k; r++)
+        cut[p * k + r] =
+            int(lower_bound(runs[r].b, runs[r].b + runs[r].n, sp) - runs[r].b);
+    }
+
+    vector<long> base(np + 1, 0), cnt(np, 0); // partition in tmp, # written
+    for (int p = 0; p < np; p++) {
+      base[p + 1] = base[p];
+      for (int r = 0; r < k; r++)
+        base[p + 1] += cut[(p + 1) * k + r] - cut[p * k + r];
+    }
+
+    vector<T> tmp(total);
+    Thread(np).run([&](int p) {
+      vector<int> pos(k), end(k), heap;
+      for (int r = 0; r < k; r++) {
+        pos[r] = cut[p * k + r], end[r] = cut[(p + 1) * k + r];
+        if (pos[r] < end[r])
+          heap.push_back(r);
+      }
+      auto after = [&runs, &pos](int a, int b) { // min heap on (x, run)
+        const T &xa = runs[a].b[pos[a]], &xb = runs[b].b[pos[b]];
+        return xb < xa || (!(xa < xb) && b < a);
+      };
+      std::make_heap(heap.begin(), heap.end(), after);
+
+      T *o0 = tmp.data() + base[p], *o = o0;
+      auto write = [&](int r) {
+        const T &x = runs[r].b[pos[r]++];
+        if (!unique || o == o0 || o[-1] < x)
+          *o++ = emit(r, x);
+      };
+      while (heap.size() > 1) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        int r = heap.back();
+        write(r);
+        if (pos[r] < end[r])
+          std::push_heap(heap.begin(), heap.end(), after);
+        else
+          heap.pop_back();
+      }
+      for (int r : heap) // last run left, no heap
+        while (pos[r] < end[r])
+          write(r);
+      cnt[p] = o - o0;
+    });
+
+    if (!unique) {
+      out.swap(tmp);
+      return;
+    }
+
+    vector<long> at(np + 1, 0); // compact the partitions
+    for (int p = 0; p < np; p++)
+      at[p + 1] = at[p] + cnt[p];
+    out.resize(at[np]);
+    Thread(np).run([&](int p) {
+      copy(tmp.begin() + base[p], tmp.begin() + base[p] + cnt[p],
+           out.begin() + at[p]);
     });
   }
 
   int set_vertexes(Vertexes &vertexes) { // v = vertexes
     v.resize(vertexes.size());
-    Thread(vertexes.size()).run([this, &vertexes](int i) {
-      v[i] = {to_int4(i), {0, vertexes[i]}};
+    pts = vertexes;
+    Thread(vertexes.size()).run([this](int i) {
+      v[i] = {key(i), uint32_t(i)};
     });
     return vertexes.size();
   }
 
-  inline void add_face(Int4 i0, Int4 i1, Int4 i2) { m.push_back({i0, i1, i2}); }
-  inline void add_face(vector<Int4> v) { fcs.push_back(v); }
-
-  inline void add_vertex(Int4 ix, Vertex vtx) { // to v
-    v.push_back({ix, {v_index++, vtx}});
+  // single thread, incremental build
+  inline void add_face(Key face, Key from, Key to) {
+    m.push_back({face, from, to});
   }
-
-  inline int set_vertex(int i, Int4 ix, Vertex vtx) {
-    v[i] = {ix, {0, vtx}};
-    return i;
+  inline void add_face(vector<Key> const &keys) {
+    fc_keys.insert(fc_keys.end(), keys.begin(), keys.end());
+    fc_offsets.push_back(fc_keys.size());
   }
 
-  inline I4Vix find_vertex(Int4 _v) {
-    return *lower_bound(v.begin(), v.end(), _v, I4Vix::less);
+  inline void add_vertex(Key ix, Vertex vtx) { // to v, pts
+    v.push_back({ix, uint32_t(pts.size())});
+    pts.push_back(vtx);
   }
 
-  inline int find_vertex_index(Int4 _v) {
-    return lower_bound(v.begin(), v.end(), _v, I4Vix::less)->vix.index;
+  inline int set_vertex(int i, Key ix, Vertex vtx) {
+    v[i] = {ix, v[i].ix};
+    pts[v[i].ix] = vtx;
+    return i;
   }
 
-  inline Int4 find_m(Int4 _m0, Int4 _m1) {
-    return (*lower_bound(m.begin(), m.end(), MapIndex(_m0, _m1, 0))).i2;
+  inline int find_vertex_index(Key _v) { // v sorted & unique
+    return int(lower_bound(v.begin(), v.end(), _v, KeyIx::less) - v.begin());
   }
 
   // gen. vector of from index of face change in m
   vector<int> from_to_m() {
     vector<int> v_ft;
-    Int4 c0 = m[0].i0;
+    if (m.empty())
+      return v_ft;
+
+    Key c0 = m[0].face;
     int from = 0;
 
     for (int i = 0; i < m.size(); i++) {
-      if (m[i].i0 != c0) {
+      if (m[i].face != c0) {
         v_ft.push_back(from);
         from = i;
-        c0 = m[i].i0;
+        c0 = m[i].face;
       }
     }
     v_ft.push_back(from);
@@ -184,70 +552,157 @@ public:
     return v_ft;
   }
 
-  void to_poly() { // v,m -> vertexes, faces
+  void to_poly() { combine(); } // v,m -> vertexes, faces
 
-    index_vertexes();
+  void sort_m() { // segments sorted on their own, then merged
+    int n = m.size();
+    Thread th(n);
+    vector<Run<MapKey>> runs(th.nth);
 
-    faces.clear();
+    th.run([this, &runs](int t, int from, int to) {
+      std::sort(m.begin() + from, m.begin() + to);
+      runs[t] = {m.data() + from, to - from};
+    });
 
-    process_m();
+    vector<MapKey> mm;
+    merge_runs(runs, mm, false,
+               [](int, const MapKey &x) -> const MapKey & { return x; });
+    m.swap(mm);
   }
 
-  void process_m() { // m->faces
-    if (!m.empty()) {
-      // sort m
-      sort(m.begin(), m.end(), MapIndex::less);
-
-      auto ft = from_to_m(); // from index in m (segments of i0)
-      faces = Faces(ft.size());
-
-      Thread(ft.size()).run([this, &ft](int fti) {
-        int i = ft[fti];
+  vector<int> m_face_sizes(vector<int> &ft) { // # of flags in each face segment
+    vector<int> sizes(ft.size());
+    for (size_t fti = 0; fti < ft.size(); fti++)
+      sizes[fti] = (fti + 1 < ft.size() ? ft[fti + 1] : m.size()) - ft[fti];
+    return sizes;
+  }
 
-        auto &m0 = m[i];
-        Int4 _v0 = m0.i2, _v = _v0, _m0 = m0.i0;
+  // vertex index of each m[j].from, -1 if not in v: the (from, j) pairs
+  // sorted (radix, all kept) and merged with the sorted v in one pass, each
+  // partition from its lower_bound
+  vector<int> m_from_indexes() {
+    int n = m.size(), nv = v.size();
+    vector<KeyIx> sorted(n);
+    Thread(n).run(
+        [this, &sorted](int j) { sorted[j] = {m[j].from, uint32_t(j)}; });
+    if (use_radix && n >= radix_min)
+      radix_sort_unique(sorted.data(), n, false);
+    else
+      std::stable_sort(sorted.begin(), sorted.end());
+
+    vector<int> ix(n);
+    Thread(n).run([this, &sorted, &ix, nv](int, int from, int to) {
+      for (int j = from, i = find_vertex_index(sorted[from].key); j < to;
+           j++) {
+        for (; i < nv && v[i].key < sorted[j].key; i++)
+          ;
+        ix[sorted[j].ix] = i < nv && v[i].key == sorted[j].key ? i : -1;
+      }
+    });
+    return ix;
+  }
 
-        // traverse _m0
-        Face face;
-        do {
-          face.push_back(find_vertex_index(_v));
-          _v = find_m(_m0, _v);
-        } while (_v != _v0);
+  // each face is a segment m[b..e) sorted by 'from': the successor of a flag
+  // (the one whose 'from' is its 'to') is looked up in the segment only,
+  // the vertex indexes come from m_from_indexes. a face whose cycle does not
+  // close (open polyhedra) is its chain from the flag no other leads to,
+  // each flag once, up to a missing successor or a key not in v.
+  // -> indexes filled per face, for cut_faces
+  vector<int> fill_m_faces(vector<int> &ft) { // faces[0..ft.size()) << m
+    auto ix = m_from_indexes();
+    vector<int> len(ft.size());
+
+    Thread(ft.size(), // cost: # of flags in face segment
+           [this](int fti) { return int(faces[fti].size()); })
+        .run([this, &ft, &ix, &len](int fti) {
+          int b = ft[fti], k = faces[fti].size();
+          auto sb = m.begin() + b, se = sb + k;
+          auto succ = [sb, se, k](int j) { // local: from == sb[j].to, or k
+            auto it = lower_bound(sb, se, sb[j].to,
+                                  [](const MapKey &a, const Key &to) {
+                                    return a.from < to;
+                                  });
+            return it != se && it->from == sb[j].to ? int(it - sb) : k;
+          };
+
+          // traverse the segment from its first flag
+          auto face = faces[fti];
+          int ic = 0, s = 0;
+          for (int j = 0; ic < k; j = s) {
+            if ((s = succ(j)) == k || ix[b + s] < 0)
+              break;
+            face[ic++] = ix[b + s];
+            if (s == 0)
+              break;
+          }
+          if (s != 0 || ic != k) { // open: the chain from its head
+            vector<bool> led(k), seen(k);
+            for (int j = 0; j < k; j++)
+              if ((s = succ(j)) != k && s != j)
+                led[s] = true;
+            int h = int(std::find(led.begin(), led.end(), false) - led.begin());
+            ic = 0;
+            for (int j = h < k ? h : 0; j < k && !seen[j] && ix[b + j] >= 0;
+                 j = succ(j))
+              seen[j] = true, face[ic++] = ix[b + j];
+          }
+          len[fti] = ic;
+        });
+    return len;
+  }
 
-        faces[fti] = face;
-      });
+  // faces [0, len.size()) cut to their first len[f] indexes, the ones left
+  // with less than 3 dropped, the rest kept
+  void cut_faces(const vector<int> &len) {
+    bool cut = false;
+    for (size_t f = 0; f < len.size() && !cut; f++)
+      cut = len[f] != int(faces[f].size());
+    if (!cut)
+      return;
+
+    vector<int> from, sizes; // kept faces: source, size
+    for (size_t f = 0; f < faces.size(); f++) {
+      int n = f < len.size() ? len[f] : int(faces[f].size());
+      if (n >= 3)
+        from.push_back(int(f)), sizes.push_back(n);
     }
+    Faces fs(sizes);
+    for (size_t f = 0; f < sizes.size(); f++)
+      std::copy_n(faces[from[f]].begin(), sizes[f], fs[f].begin());
+    faces = std::move(fs);
   }
 
-  struct Int4int { // face map
-    Int4 _i4;
+  struct KeyInt { // face map
+    Key key;
     int i;
-    bool operator<(const Int4int &o) const { return _i4 < o._i4; }
-    bool operator<(const Int4 &o) const { return _i4 < o; }
-    bool operator()(const Int4int &a, const Int4 &b) const { return a._i4 < b; }
-    static Int4 find(const vector<Int4int> &iv, Int4 k) {
-      return i4(lower_bound(iv.begin(), iv.end(), k)->i);
+    bool operator<(const KeyInt &o) const { return key < o.key; }
+    bool operator<(const Key &o) const { return key < o; }
+    static Key find(const vector<KeyInt> &iv, Key k) {
+      return ::key(lower_bound(iv.begin(), iv.end(), k)->i);
     }
-    static void sort(vector<Int4int> &iv) { std::sort(iv.begin(), iv.end()); }
+    static void sort(vector<KeyInt> &iv) { std::sort(iv.begin(), iv.end()); }
   };
 
-  static vector<Int4int> gen_face_map(Polyhedron &poly) {
+  static vector<KeyInt> gen_face_map(Polyhedron &poly) {
     // make table of face as fn of edge
 
-    vector<Int4int> face_map;
+    vector<KeyInt> face_map;
 
     for (int i = 0; i < poly.n_faces; i++) {
-      auto &f = poly.faces[i];
+      auto f = poly.faces[i];
       auto v1 = f.back(); // previous vertex index
       for (auto v2 : f) {
-        face_map.push_back({i4(v1, v2), i});
+        face_map.push_back({key(v1, v2), i});
         v1 = v2; // current becomes previous
       }
     }
-    Int4int::sort(face_map);
+    KeyInt::sort(face_map);
 
     return face_map;
   }
+
+private:
+  vector<Count> at; // slots of face f start at at[f] (alloc)
 };
 
 #endif // FASTFLAGS_H
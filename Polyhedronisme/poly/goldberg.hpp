@@ -0,0 +1,127 @@
+//
+//  goldberg.hpp
+//  test_polygon
+//
+
+#ifndef goldberg_hpp
+#define goldberg_hpp
+
+#include "common.hpp"
+#include <array>
+#include <numeric>
+
+// the triangular lattice of the Goldberg-Coxeter operator GC(a, b) over one
+// master triangle, the same for every face. lattice coords (x, y) on
+// e1 = (1, 0), e2 = (1/2, sqrt(3)/2); the master corners 0, 1, 2 are
+// O = (0, 0), P = (a, b), Q = (-b, a + b), T = a^2 + ab + b^2 small
+// triangles of area. a point is told by its barycentrics * T (integers):
+// a corner, a point of side s (corner s -> s + 1: g - 1 inside, g =
+// gcd(a, b)), an inner point or out of the master (classes II, III: the
+// small triangles cross the sides). a small triangle belongs to the master
+// that holds its centroid; one on side s (class II) to the owner of the edge
+class GCLattice {
+public:
+  struct Ref {
+    enum Kind : uint8_t { corner, side, inner, out } kind;
+    uint8_t s; // corner / side / side crossed (out)
+    int k;     // side: point 1..g-1 from corner s, inner: index, out: outs[k]
+  };
+  using Bary = std::array<long, 3>; // barycentrics * T, sum T
+
+  int a, b;
+  long T;
+  int g;
+  vector<std::array<float, 3>> inners;   // barycentrics of the inner points
+  vector<std::array<Ref, 3>> triangles;  // ccw, as the master corners
+  vector<int8_t> on_side;                // side of the centroid, -1 inside
+  vector<Bary> outs;                     // points out of the master
+  int n_inside = 0, n_on_side = 0;       // triangles, n_on_side per side
+
+  GCLattice(int a, int b)
+      : a(a), b(b), T(long(a) * a + long(a) * b + long(b) * b),
+        g(std::gcd(a, b)) {
+    int h = a + b;
+    rows.resize(h + 1);
+    for (int y = 0; y <= h; y++) { // inner points: a run of x per row
+      auto &r = rows[y];
+      r.start = inners.size(), r.xlo = 0;
+      for (int x = -b; x <= a; x++) {
+        auto l = bary(x, y);
+        if (l[0] > 0 && l[1] > 0 && l[2] > 0) {
+          if (int(inners.size()) == r.start)
+            r.xlo = x;
+          inners.push_back(
+              {float(l[0]) / T, float(l[1]) / T, float(l[2]) / T});
+        }
+      }
+    }
+
+    // up (x, y) (x+1, y) (x, y+1), down (x+1, y) (x+1, y+1) (x, y+1)
+    static const int corners[2][3][2] = {{{0, 0}, {1, 0}, {0, 1}},
+                                         {{1, 0}, {1, 1}, {0, 1}}};
+    for (int y = -1; y <= h; y++)
+      for (int x = -b - 1; x <= a; x++)
+        for (int d = 0; d < 2; d++) {
+          auto c = bary(3 * x + 1 + d, 3 * y + 1 + d, 3); // centroid
+          int zero = -1;
+          if (c[0] < 0 || c[1] < 0 || c[2] < 0)
+            continue;
+          for (int i = 0; i < 3; i++)
+            zero = c[i] == 0 ? i : zero;
+
+          std::array<Ref, 3> t;
+          for (int i = 0; i < 3; i++) {
+            auto l = bary(x + corners[d][i][0], y + corners[d][i][1]);
+            t[i] = classify(l);
+            if (t[i].kind == Ref::out) { // resolved in the neighbor
+              t[i].k = outs.size();
+              outs.push_back(l);
+            }
+          }
+          triangles.push_back(t);
+          on_side.push_back(zero == -1 ? -1 : (zero + 1) % 3);
+          n_inside += zero == -1;
+          n_on_side += zero == 2; // side 0
+        }
+  }
+
+  // barycentrics * T * scale of (x, y) / scale: l1 = X x Q, l2 = P x X
+  Bary bary(long x, long y, long scale = 1) const {
+    long l1 = x * (a + b) + y * b, l2 = a * y - b * x;
+    return {scale * T - l1 - l2, l1, l2};
+  }
+
+  Ref classify(const Bary &l) const {
+    for (int c = 0; c < 3; c++)
+      if (l[c] < 0)
+        return {Ref::out, uint8_t((c + 1) % 3), 0};
+    for (int c = 0; c < 3; c++)
+      if (l[c] == T)
+        return {Ref::corner, uint8_t(c), 0};
+    for (int c = 0; c < 3; c++)
+      if (l[c] == 0) {
+        int s = (c + 1) % 3;
+        return {Ref::side, uint8_t(s), int(l[(s + 1) % 3] * g / T)};
+      }
+    long x = (l[1] * a - l[2] * b) / T, y = (l[1] * b + l[2] * (a + b)) / T;
+    auto &r = rows[y];
+    return {Ref::inner, 0, int(r.start + x - r.xlo)};
+  }
+
+  // l of the master across side s, its side t (the same edge, reversed)
+  static Bary across(const Bary &l, int s, int t) {
+    Bary m;
+    int s1 = (s + 1) % 3, s2 = (s + 2) % 3;
+    m[t] = l[s1] + l[s2], m[(t + 1) % 3] = l[s] + l[s2];
+    m[(t + 2) % 3] = -l[s2];
+    return m;
+  }
+
+private:
+  struct Row {
+    int start, xlo; // index of the first inner point of the row, its x
+  };
+  vector<Row> rows;
+};
+
+#endif /* goldberg_hpp */
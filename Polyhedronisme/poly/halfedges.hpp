@@ -0,0 +1,127 @@
+//
+//  halfedges.hpp
+//  test_polygon
+//
+
+#ifndef halfedges_hpp
+#define halfedges_hpp
+
+#include "Thread.h"
+#include "common.hpp"
+
+// half-edges of CSR faces: half-edge p is the corner faces.indexes[p], the
+// edge that ends there from the previous corner of its face. out[] lists the
+// half-edges leaving each vertex (counting sort on 'from'), the twin of u->v
+// is the one of out(v) that ends in u. 'closed': every half-edge has its own
+// twin, whose twin it is. built in O(E), every pass parallel; holds a copy
+// of the faces, so Polyhedron can cache & share it (get_halfedges)
+class HalfEdges {
+public:
+  vector<int> face;        // face of half-edge p
+  vector<int> twin;        // v->u of u->v, -1: border
+  vector<int> out_offsets; // out[out_offsets[v]..out_offsets[v+1])
+  vector<int> out;         // half-edges leaving v, ascending
+  bool closed = true;
+
+  HalfEdges(const Faces &faces, int n_vertex)
+      : face(faces.n_indexes()), twin(faces.n_indexes()),
+        out_offsets(n_vertex + 1, 0), out(faces.n_indexes()), faces(faces) {
+    int nf = faces.size(), ne = faces.n_indexes();
+
+    // counting sort on 'from' by segments of faces: per segment counts ->
+    // slots -> scatter of its half-edges in order, so out(v) is ascending,
+    // no atomics. segments: at most max_segments, their counts are [s][v]
+    int ns = std::min(Thread::getnthreads(), max_segments);
+    vector<int> at(size_t(ns) * n_vertex, 0);
+    auto leaving = [&faces, nf, ns](int s, auto visit) { // visit(f, p, from)
+      for (int f = long(nf) * s / ns; f < long(nf) * (s + 1) / ns; f++) {
+        int b = faces.offsets[f], e = faces.offsets[f + 1];
+        for (int p = b, u = faces.indexes[e - 1]; p < e; u = faces.indexes[p++])
+          visit(f, p, u);
+      }
+    };
+    Thread(ns).run([this, &at, &leaving, n_vertex](int s) {
+      int *count = at.data() + size_t(s) * n_vertex;
+      leaving(s, [this, count](int f, int p, int u) {
+        face[p] = f;
+        count[u]++;
+      });
+    });
+    Thread(n_vertex).run([this, &at, ns, n_vertex](int v) {
+      for (int s = 0; s < ns; s++)
+        out_offsets[v + 1] += at[size_t(s) * n_vertex + v];
+    });
+    for (int v = 0; v < n_vertex; v++)
+      out_offsets[v + 1] += out_offsets[v];
+    Thread(n_vertex).run([this, &at, ns, n_vertex](int v) {
+      for (int s = 0, slot = out_offsets[v]; s < ns; s++) {
+        int &c = at[size_t(s) * n_vertex + v];
+        std::swap(c, slot);
+        slot += c;
+      }
+    });
+    Thread(ns).run([this, &at, &leaving, n_vertex](int s) {
+      int *slot = at.data() + size_t(s) * n_vertex;
+      leaving(s, [this, slot](int, int p, int u) { out[slot[u]++] = p; });
+    });
+
+    std::atomic<bool> all{true};
+    Thread(nf).run([this, &faces, &all](int f) {
+      int b = faces.offsets[f], e = faces.offsets[f + 1];
+      for (int p = b, u = faces.indexes[e - 1], v; p < e; p++, u = v) {
+        v = faces.indexes[p];
+        twin[p] = -1;
+        for (int i = out_offsets[v]; i < out_offsets[v + 1]; i++)
+          if (to(out[i]) == u) {
+            twin[p] = out[i];
+            break;
+          }
+        if (twin[p] == -1)
+          all = false;
+      }
+    });
+    Thread(ne).run([this, &all](int p) { // one twin per edge
+      if (twin[p] != -1 && twin[twin[p]] != p)
+        all = false;
+    });
+    closed = all;
+  }
+
+  inline int prev(int p) const { // previous half-edge in its face
+    return p == faces.offsets[face[p]] ? faces.offsets[face[p] + 1] - 1
+                                       : p - 1;
+  }
+  inline int next(int p) const { // next half-edge in its face
+    return p + 1 == faces.offsets[face[p] + 1] ? faces.offsets[face[p]]
+                                               : p + 1;
+  }
+  inline int to(int p) const { return faces.indexes[p]; }
+  inline int from(int p) const { return faces.indexes[prev(p)]; }
+  inline int degree(int v) const {
+    return out_offsets[v + 1] - out_offsets[v];
+  }
+
+  vector<int> used_vertexes() const { // the ones with half-edges, in order
+    vector<int> vs;
+    for (int v = 0; v + 1 < int(out_offsets.size()); v++)
+      if (degree(v))
+        vs.push_back(v);
+    return vs;
+  }
+
+  // leaving v: the half-edges around v, face by face: q -> twin(prev(q))
+  inline int next_around(int q) const { return twin[prev(q)]; }
+
+  static constexpr int max_segments = 8; // of the build: temp. 4 bytes * v each
+
+  size_t bytes() const {
+    return (face.size() + twin.size() + out_offsets.size() + out.size()) *
+               sizeof(int) +
+           faces.bytes();
+  }
+
+private:
+  const Faces faces; // own copy: valid after the source is moved
+};
+
+#endif /* halfedges_hpp */
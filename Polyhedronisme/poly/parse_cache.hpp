@@ -0,0 +1,130 @@
+//
+//  parse_cache.hpp
+//  test_polygon
+//
+
+#ifndef parse_cache_hpp
+#define parse_cache_hpp
+
+#include "common.hpp"
+#include "counts.hpp"
+#include "polyhedron.hpp"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// lru of parse results keyed by the part of the notation already applied
+// (the seed and the steps right of it), bounded by the bytes of the
+// polyhedra it holds. entries are immutable & shared: a hit is copied out
+// of the lock. each holds the parse state a hit restores (Info). one per
+// process (Parser::cache), thread safe
+class ParseCache {
+public:
+  struct Info {
+    bool canonical = true; // each K applied converged
+    Counts counts;         // predicted of the result, and the peak
+    size_t peak = 0;
+  };
+
+  struct Hit {
+    int k = -1; // index of the key, -1: none cached
+    std::shared_ptr<const Polyhedron> poly;
+    Info info;
+  };
+
+  struct Stats {
+    long hits = 0;      // parses resumed from a cached suffix
+    long misses = 0;    // parses from the seed
+    long evictions = 0; // entries dropped for the budget
+    long inserts = 0;
+    size_t bytes = 0;
+    size_t entries = 0;
+  };
+
+  explicit ParseCache(size_t budget = size_t(256) << 20) : max_bytes(budget) {}
+
+  void set_budget(size_t budget) { // evicts down to it
+    std::lock_guard<std::mutex> lock(mtx);
+    max_bytes = budget;
+    evict(0);
+  }
+  size_t budget() const { return max_bytes; }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    st.bytes = used, st.entries = lru.size();
+    return st;
+  }
+  void reset_stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    st = Stats();
+  }
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    lru.clear(), index.clear(), used = 0;
+  }
+
+  // the last of keys cached (the longest part applied): its index, its
+  // polyhedron and info. counts a hit or a miss
+  Hit longest(const vector<string> &keys) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (int k = int(keys.size()) - 1; k >= 0; k--) {
+      auto it = index.find(keys[k]);
+      if (it != index.end()) {
+        lru.splice(lru.begin(), lru, it->second); // most recent
+        st.hits++;
+        return {k, it->second->poly, it->second->info};
+      }
+    }
+    st.misses++;
+    return Hit();
+  }
+
+  // a copy of p and its info under key, replacing its entry. no-op if it
+  // alone is over the budget
+  void put(const string &key, const Polyhedron &p, const Info &info) {
+    size_t bytes = key.size() + p.bytes();
+    if (bytes > max_bytes)
+      return;
+    auto poly = std::make_shared<const Polyhedron>(p); // copy out of the lock
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = index.find(key);
+    if (it != index.end()) {
+      used -= it->second->bytes;
+      lru.erase(it->second);
+      index.erase(it);
+    }
+    evict(bytes);
+    lru.push_front({key, std::move(poly), info, bytes});
+    index[key] = lru.begin();
+    used += bytes;
+    st.inserts++;
+  }
+
+private:
+  struct Entry {
+    string key;
+    std::shared_ptr<const Polyhedron> poly;
+    Info info;
+    size_t bytes;
+  };
+
+  std::mutex mtx;
+  std::list<Entry> lru; // most recent first
+  std::unordered_map<string, std::list<Entry>::iterator> index;
+  size_t max_bytes, used = 0;
+  Stats st;
+
+  void evict(size_t room) { // least recent out until room fits
+    while (!lru.empty() && used + room > max_bytes) {
+      used -= lru.back().bytes;
+      index.erase(lru.back().key);
+      lru.pop_back();
+      st.evictions++;
+    }
+  }
+};
+
+#endif /* parse_cache_hpp */
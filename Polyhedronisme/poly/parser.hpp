@@ -9,9 +9,12 @@
 #ifndef parser_hpp
 #define parser_hpp
 
+#include "admission.hpp"
 #include "common.hpp"
+#include "counts.hpp"
 #include "poly_operations_mt.hpp"
 #include "polyhedron.hpp"
+#include "parse_cache.hpp"
 #include "seeds.hpp"
 #include <ctype.h>
 
@@ -19,60 +22,201 @@ class Parser {
 public:
   Parser() {}
 
-  static void test_tuple_performance() {
+  static inline bool use_fusion = true; // dk, da as one kernel
 
-    int n = 2e6;
-    vector<Int4> _v4;
-    vector<Int4> v4;
-    Int4 i0, i1(1), i2(1, 2), i3(1, 2, 3), i4(1, 2, 3, 4);
+  struct Step { // a transformation
+    char op = 0;
+    int n = 0, m = 0;   // N or N,M: kN nN xN lN uN KN GN,M
+    bool fused = false; // with a d after it (kd, ad: use_fusion) or SG
+  };
 
-    Timer t;
+  // compiled notation: the seed, then the steps in the order they apply,
+  // after the identities of compile. cost: edges built (output edges of
+  // each step, seed edges = 1), the plan's and the notation's as written.
+  // parse adds the predicted counts of the result and peak bytes
+  struct Plan {
+    char base = 0;
+    string sn; // N of the seed as written
+    vector<Step> steps;
+    int written = 0; // transformations as written
+    double cost = 0, written_cost = 0;
+    Counts counts;
+    size_t peak = 0;
+    bool admitted = true;
+    bool canonical = true; // each K parse applied converged
 
-    _v4.resize(n);
-    t.timer("_Int4 init");
-    v4.resize(n);
-    t.timer("Int4 init");
+    string str(size_t k = string::npos) const { // notation of steps [0, k)
+      string s;
+      for (size_t i = 0; i < std::min(k, steps.size()); i++) {
+        auto &st = steps[i];
+        string t(1, st.op);
+        if (st.n || st.m)
+          t += std::to_string(st.n) + (st.m ? "," + std::to_string(st.m) : "");
+        s = (st.fused ? string(1, st.op == 'G' ? 'S' : 'd') : "") + t + s;
+      }
+      return base ? s + base + sn : s;
+    }
+    string summary() const { // for the log
+      char b[128];
+      snprintf(b, sizeof(b), "%d of %d steps, cost %.0f of %.0f (-%.0f%%)",
+               int(steps.size()), written, cost, written_cost,
+               written_cost > 0 ? 100 * (1 - cost / written_cost) : 0);
+      string r = str() + ": " + b;
+      if (peak) {
+        snprintf(b, sizeof(b), ", V%ld E%ld F%ld%s, peak %.1fmb", counts.V,
+                 counts.E, counts.F, counts.exact ? "" : "?", peak / 1e6);
+        r += b;
+      }
+      if (!canonical)
+        r += ", K not converged";
+      return admitted ? r : r + ", rejected";
+    }
+  };
 
-    for (int i = 0; i < n; i++)
-      _v4[i] = Int4(rand(), rand(), rand(), rand());
-    t.timer("_Int4 fill");
-    for (int i = 0; i < n; i++)
-      v4[i] = Int4(rand(), rand(), rand(), rand());
-    t.timer("Int4 fill");
+  // identities applied by compile (closed polyhedra): dd drops, ad = a,
+  // gd = g, SS = S; r commutes with the achiral operators and rr drops: r
+  // moves up to the next chiral step or the end, one if odd. after H (open)
+  // only the r and S ones
+  static inline bool use_simplify = true;
 
-    sort(_v4.begin(), _v4.end());
-    t.timer("sort _Int4");
+  static Plan compile(string s) { // ttttBN
+    Plan plan;
+    size_t slen = s.length(), i = 0;
 
-    sort(v4.begin(), v4.end());
-    t.timer("sort Int4");
+    reverse(s.begin(), s.end()); // NBtttt
 
-    printf("is sorted _v4:%d, v4:%d\n", std::is_sorted(_v4.begin(), _v4.end()),
-           std::is_sorted(v4.begin(), v4.end()));
-  }
+    for (i = 0; isdigit(s[i]); i++)
+      plan.sn += s[i]; // N
+    reverse(plan.sn.begin(), plan.sn.end());
+    plan.base = s[i];
 
-  static Polyhedron parse(string s) { // ttttBN
-    Polyhedron p;
-    int n = 0;
-    size_t slen = s.length(), i = 0;
-    string sd;
+    for (size_t j = i + 1; j < slen;) {
+      auto st = next_step(s, j);
+      if (st.op && strchr(operators, st.op))
+        plan.steps.push_back(st);
+    }
+    plan.written = plan.steps.size();
+    plan.written_cost = cost(plan.steps);
 
-//    test_tuple_performance();
+    if (use_simplify)
+      simplify(plan.steps);
+    for (size_t k = 0; k + 1 < plan.steps.size(); k++) { // fusion
+      auto &st = plan.steps[k];
+      char next = plan.steps[k + 1].op;
+      st.fused = (st.op == 'G' && next == 'S') ||
+                 (use_fusion && !st.n && next == 'd' &&
+                  (st.op == 'k' || st.op == 'a'));
+      if (st.fused)
+        plan.steps.erase(plan.steps.begin() + k + 1);
+    }
+    plan.cost = cost(plan.steps);
+    return plan;
+  }
 
-    reverse(s.begin(), s.end()); // NBtttt
+  static Plan &last_plan() { // of the latest parse
+    static thread_local Plan plan;
+    return plan;
+  }
 
-    for (i = 0; isdigit(s[i]); i++)
-      sd += s[i]; // N
+  // parse resumes from the longest applied part of the plan found in the
+  // cache (the seed and the transformations right of an edit) and caches
+  // each part it applies: kqqqqD after qqqqD applies only k. a hit restores
+  // the plan state of its part (K convergence; counts & peak if final)
+  static inline bool use_cache = true;
+  static ParseCache &cache() { // budget: cache().set_budget(bytes)
+    static ParseCache c;
+    return c;
+  }
+
+  // parses run once admitted for their predicted peak (Admission): one over
+  // the budget returns an empty polyhedron, plan not admitted
+  static Admission &admission() { // budget: admission().set_budget(bytes)
+    static Admission a;
+    return a;
+  }
 
-    if (!sd.empty()) {
-      reverse(sd.begin(), sd.end());
+  static Polyhedron parse(string s) { // ttttBN
+    Polyhedron p;
+    auto &plan = last_plan() = compile(s);
+    int n = 0;
+    if (!plan.sn.empty()) {
       try {
-        n = std::stoi(sd);
+        n = std::stoi(plan.sn);
       } catch (std::invalid_argument) {
         n = -1;
       }
     }
 
-    switch (s[i]) { //  base poly
+    // keys: fusion mode + notation of the steps applied, longest last
+    int ns = plan.steps.size(), k = -1;
+    vector<string> keys;
+    for (int j = 0; j <= ns; j++)
+      keys.push_back((use_fusion ? "f" : "-") + plan.str(j));
+
+    if (use_cache) {
+      auto hit = cache().longest(keys);
+      k = hit.k;
+      if (hit.poly) {
+        p = *hit.poly;
+        plan.canonical = hit.info.canonical;
+        if (k == ns && p.is_valid(Polyhedron::a_colors)) { // a final result
+          plan.counts = hit.info.counts, plan.peak = hit.info.peak;
+          return p;
+        }
+      }
+    }
+    if (k == -1) {
+      if (!seed(plan.base, n, p))
+        return p; // wrong base
+      k = 0;
+    }
+
+    auto ticket = admit(plan, p, k);
+    if (!ticket)
+      return Polyhedron();
+    for (; k < ns; k++) {
+      apply(plan.steps[k], p);
+      if (use_cache && k + 1 < ns)
+        cache().put(keys[k + 1], p, info(plan));
+    }
+
+    p.recalc();
+    if (use_cache && ns)
+      cache().put(keys[ns], p, info(plan));
+    return p;
+  }
+
+private:
+  static ParseCache::Info info(const Plan &plan) { // of the steps applied
+    return {plan.canonical, plan.counts, plan.peak};
+  }
+
+  // counts of the result predicted from p, steps [k, ns) to apply, and the
+  // peak: a step's input and output, its temporaries as much again. not
+  // admitted: over the budget or int indexes
+  static Admission::Ticket admit(Plan &plan, Polyhedron &p, int k) {
+    auto c = Counts::of(p, p.get_halfedges().closed);
+    size_t peak = c.bytes();
+    for (int j = k; j < int(plan.steps.size()); j++) {
+      auto &st = plan.steps[j];
+      auto next = c.apply(st.op, st.n, st.m);
+      if (st.fused)
+        next = next.apply(st.op == 'G' ? 'S' : 'd');
+      peak = std::max(peak, c.bytes() + 2 * next.bytes());
+      c = next;
+    }
+    plan.counts = c, plan.peak = peak;
+    if (2 * c.E < INT_MAX && c.V < INT_MAX) {
+      auto ticket = admission().acquire(peak);
+      if (ticket)
+        return ticket;
+    }
+    plan.admitted = false;
+    return Admission::Ticket();
+  }
+
+  static bool seed(char c, int n, Polyhedron &p) {
+    switch (c) { //  base poly
     case 'T':
       p = Seeds::tetrahedron();
       break;
@@ -107,61 +251,199 @@ public:
       p = Seeds::johnson(n);
       break;
     default:
-      return p; // wrong base
+      return false; // wrong base
     }
 
-    for (i++; i < slen; i++) { // transformations: dagprPqkcwnxlH
-      switch (s[i]) {
-      case 'd':
-        p = PolyOperations::dual(p);
-        break;
+    return true;
+  }
+
+  static constexpr const char *operators = "dagprPqkcwnxlHKuGS";
+
+  static Step next_step(const string &s, size_t &i) { // s reversed: Nop
+    Step st;
+    string sn;
+    for (; i < s.size() && (isdigit(s[i]) || s[i] == ','); i++)
+      sn += s[i];
+    if (!sn.empty()) {
+      reverse(sn.begin(), sn.end());
+      sscanf(sn.c_str(), "%9d,%9d", &st.n, &st.m); // at most 9 digits each
+    }
+    if (i < s.size()) // else N of nothing
+      st.op = s[i++];
+    return st;
+  }
+
+  // chiral: the mirror image of op(X) is op'(rX) (the other hand), r does
+  // not commute with it. g, p, w and G a,b with a != b, both > 0
+  static bool chiral(const Step &st) {
+    if (st.op == 'G') {
+      int a = st.n || st.m ? st.n : 1, b = st.m;
+      return a && b && a != b;
+    }
+    return strchr("gpw", st.op) != nullptr;
+  }
+
+  // reduced as a stack: a step against the top, r counted apart and put
+  // back before a chiral step
+  static void simplify(vector<Step> &steps) {
+    vector<Step> out;
+    bool r = false, open = false;
+    for (auto &st : steps) {
+      if (st.op == 'r') {
+        r = !r;
+        continue;
+      }
+      if (r && chiral(st))
+        out.push_back(Step{'r'}), r = false;
+      char top = out.empty() ? 0 : out.back().op;
+      if (top == 'S' && st.op == 'S')
+        continue;
+      if (top == 'd' && !open) {
+        if (st.op == 'd') {
+          out.pop_back();
+          continue;
+        }
+        if (st.op == 'a' || st.op == 'g') {
+          out.back() = st;
+          continue;
+        }
+      }
+      open |= st.op == 'H';
+      out.push_back(st);
+    }
+    if (r)
+      out.push_back(Step{'r'});
+    steps = out;
+  }
+
+  // edges built by the steps, seed edges = 1: output edges of each, kN nN
+  // xN as all faces, u and G as all triangles, K one pass, r none (in place)
+  static double cost(const vector<Step> &steps) {
+    double e = 1, c = 0;
+    for (auto &st : steps) {
+      if (st.op == 'r')
+        continue;
+      double f = 1;
+      switch (st.op) {
       case 'a':
-        p = PolyOperations::ambo(p);
+        f = 2;
         break;
-      case 'g':
-        p = PolyOperations::gyro(p);
-        break;
-      case 'p':
-        p = PolyOperations::propellor(p);
+      case 'k':
+        f = 3;
         break;
-      case 'r':
-        p = PolyOperations::reflect(p);
+      case 'c':
+        f = 4;
         break;
-      case 'P':
-        p = PolyOperations::perspectiva1(p);
+      case 'g':
+      case 'p':
+      case 'n':
+      case 'x':
+      case 'l':
+        f = 5;
         break;
       case 'q':
-        p = PolyOperations::quinto(p);
-        break;
-
-      case 'k':
-        p = PolyOperations::kisN(p);
-        break; // parameters
-      case 'c':
-        p = PolyOperations::chamfer(p);
+        f = 6;
         break;
+      case 'P':
       case 'w':
-        p = PolyOperations::whirl(p);
+        f = 7;
         break;
-      case 'n':
-        p = PolyOperations::insetN(p);
+      case 'H':
+        f = 8;
         break;
-      case 'x':
-        p = PolyOperations::extrudeN(p);
+      case 'u':
+        f = double(st.n ? st.n : 2) * (st.n ? st.n : 2);
         break;
-      case 'l':
-        p = PolyOperations::loft(p);
-        break;
-      case 'H':
-        p = PolyOperations::hollow(p);
+      case 'G': {
+        double a = st.n || st.m ? st.n : 1, b = st.m;
+        f = a * a + a * b + b * b;
         break;
+      }
+      }
+      e *= f; // fused kd, ad, SG: the edges of k, a, G
+      c += e;
+    }
+    return c;
+  }
 
-      default:
+  static void apply(const Step &st, Polyhedron &p) {
+    int pn = st.n, pm = st.m;
+    if (st.fused) {
+      switch (st.op) {
+      case 'k':
+        p = PolyOperations::truncate(p);
+        break;
+      case 'a':
+        p = PolyOperations::join(p);
+        break;
+      case 'G': // projected
+        p = PolyOperations::goldberg_coxeter(p, pn || pm ? pn : 1, pm, true);
         break;
       }
+      return;
     }
 
-    return p.recalc();
+    switch (st.op) {
+    case 'd':
+      p = PolyOperations::dual(p);
+      break;
+    case 'a':
+      p = PolyOperations::ambo(p);
+      break;
+    case 'g':
+      p = PolyOperations::gyro(p);
+      break;
+    case 'p':
+      p = PolyOperations::propellor(p);
+      break;
+    case 'r':
+      p = PolyOperations::reflect(p);
+      break;
+    case 'P':
+      p = PolyOperations::perspectiva1(p);
+      break;
+    case 'q':
+      p = PolyOperations::quinto(p);
+      break;
+
+    case 'k':
+      p = PolyOperations::kisN(p, pn);
+      break; // parameters
+    case 'c':
+      p = PolyOperations::chamfer(p);
+      break;
+    case 'w':
+      p = PolyOperations::whirl(p);
+      break;
+    case 'n':
+      p = PolyOperations::insetN(p, pn);
+      break;
+    case 'x':
+      p = PolyOperations::extrudeN(p, pn);
+      break;
+    case 'l':
+      p = PolyOperations::loft(p, pn);
+      break;
+    case 'H':
+      p = PolyOperations::hollow(p);
+      break;
+    case 'K': // N: max iterations
+      p = PolyOperations::canonicalize(p, pn ? pn : Canonical::default_iter);
+      last_plan().canonical &= Canonical::last().converged;
+      break;
+    case 'u':
+      p = PolyOperations::trisub(p, pn ? pn : 2);
+      break;
+    case 'G':
+      p = PolyOperations::goldberg_coxeter(p, pn || pm ? pn : 1, pm);
+      break;
+    case 'S':
+      p = PolyOperations::spherize(p);
+      break;
+
+    default:
+      break;
+    }
   }
 };
 
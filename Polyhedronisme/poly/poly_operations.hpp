@@ -720,7 +720,7 @@ public:
       uniqVs.push_back(v);
       for (size_t j = i + 1; j < newVs.size(); j++) {
         auto w = newVs[j];
-        if (simd_distance(v, w) < EPSILON_CLOSE)
+        if (vec::distance(v, w) < EPSILON_CLOSE)
           uniqmap[int(j)] = newpos;
       }
       newpos++;
@@ -12,7 +12,10 @@
 #include "common.hpp"
 
 #include "Thread.h"
+#include "canonical.hpp"
 #include "fastflags.h"
+#include "goldberg.hpp"
+#include "halfedges.hpp"
 #include "polyhedron.hpp"
 
 //===================================================================================================
@@ -42,50 +45,64 @@ public:
   // kis all.
   //
   static Polyhedron kisN(Polyhedron &poly, int n = 0, float apexdist = 0.1f) {
+    return kisN_direct(poly, n, apexdist);
+  }
+
+  static Polyhedron kisN_flag(Polyhedron &poly, int n = 0,
+                              float apexdist = 0.1f) {
 
-    int nth = Thread::getnthreads();
-    vector<Flag> flags(nth);
+    Flag flag;
 
-    auto normals = poly.get_normals();
-    auto centers = poly.get_centers();
+    auto &normals = poly.get_normals();
+    auto &centers = poly.get_centers();
 
     bool foundAny = false;
 
+    flag.alloc(poly.n_faces, [&poly, n](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      if (fl == n || n == 0)
+        return {2 * fl, 0, fl, 3 * fl};
+      return {fl, 0, 1, fl};
+    });
+
     // create face map
     Thread(poly.n_faces)
-        .run([&flags, &poly, &foundAny, n, apexdist, &centers,
-              &normals](int t, int nface) {
-          Flag &flag = flags[t];
-          auto &face = poly.faces[nface];
-          auto fname = i4('f', nface);
+        .run([&flag, &poly, &foundAny, n, apexdist, &centers,
+              &normals](int nface) {
+          auto fs = flag.slots(nface);
+          auto face = poly.faces[nface];
+          auto fname = key(Tag::f, nface);
 
           int v1 = face.back();
+          vector<Key> f_orig; // non n-sided face: kept as is
 
           for (auto v2 : face) {
 
-            auto iv2 = i4(v2);
+            auto iv2 = key(v2);
 
-            flag.add_vertex(iv2, poly.vertexes[v2]); // poly.vtx
+            fs.add_vertex(iv2, poly.vertexes[v2]); // poly.vtx
 
             if (face.size() == n || n == 0) {
               foundAny = true;
 
-              flag.add_vertex(fname,
-                              centers[nface] +
-                                  (normals[nface] * apexdist)); // raised center
-              flag.add_face({i4(v1), iv2, fname});
+              fs.add_vertex(fname,
+                            centers[nface] +
+                                (normals[nface] * apexdist)); // raised center
+              fs.add_face({key(v1), iv2, fname});
             } else {
-              flag.add_face({i4(v1), i4(v2)});
+              f_orig.push_back(iv2);
             }
 
             v1 = v2; // current becomes previous
           }
+          if (!f_orig.empty())
+            fs.add_face(f_orig);
         });
 
-    // combine flags->flag
-    Flag flag(flags);
+    flag.combine();
 
-    return {"k" + (n ? str(n) : "") + poly.name, flag.vertexes, flag.faces};
+    return {"k" + (n ? str(n) : "") + poly.name, std::move(flag.vertexes),
+            std::move(flag.faces)};
   }
 
   // Ambo
@@ -97,41 +114,53 @@ public:
   //
 
   static Polyhedron ambo(Polyhedron &poly) {
+    auto &he = poly.get_halfedges();
+    return he.closed ? ambo_direct(poly, he) : ambo_flag(poly);
+  }
+
+  static Polyhedron ambo_flag(Polyhedron &poly) {
+
+    Flag flag;
 
-    int nth = Thread::getnthreads();
-    vector<Flag> flags(nth);
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      auto face = poly.faces[i];
+      int fl = face.size(), nv = 0;
+      for (int j = 0; j < fl; j++) // edges v1->v2 with v1 < v2
+        nv += face[(j + fl - 1) % fl] < face[j];
+      return {nv, fl, 1, fl};
+    });
 
-    Thread(poly.n_faces).run([&flags, &poly](int t, int nface) {
-      Flag &flag = flags[t];
-      auto &face = poly.faces[nface];
+    Thread(poly.n_faces).run([&flag, &poly](int nface) {
+      auto fs = flag.slots(nface);
+      auto face = poly.faces[nface];
       auto flen = face.size();
 
       auto v1 = face[flen - 2],
            v2 = face[flen - 1]; //  [v1, v2,f.slice(-2);
 
-      vector<Int4> f_orig;
+      vector<Key> f_orig;
       for (auto v3 : face) {
-        auto m12 = i4_min(v1, v2), m23 = i4_min(v2, v3);
+        auto m12 = key_min(v1, v2), m23 = key_min(v2, v3);
 
         if (v1 < v2) // vertices are the midpoints of all edges of original poly
-          flag.add_vertex(m12, midpoint(poly.vertexes[v1], poly.vertexes[v2]));
+          fs.add_vertex(m12, midpoint(poly.vertexes[v1], poly.vertexes[v2]));
 
         // two new flags:
         // One whose face corresponds to the original f:
         f_orig.push_back(m12);
 
         // Another flag whose face  corresponds to (the truncated) v2:
-        flag.add_face(i4('dual', v2), m23, m12);
+        fs.add_face(key(Tag::dual, v2), m23, m12);
 
         // shift over one
         v1 = v2;
         v2 = v3;
       }
-      flag.add_face(f_orig);
+      fs.add_face(f_orig);
     });
 
-    Flag flag(flags);
-    return {"a" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"a" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Gyro
@@ -144,36 +173,34 @@ public:
 
   static Polyhedron gyro(Polyhedron &poly) {
 
-    Vertexes centers =
-        poly.get_centers(); // new vertices in center of each face
-
-    int nth = Thread::getnthreads(); // one flag per thread
-    vector<Flag> flags(nth);
+    auto &centers = poly.get_centers(); // new vertices in center of each face
 
     Flag flag(poly.vertexes);
 
-    Thread(poly.n_faces).run([&flags, &poly, &centers](int t, int i) {
-      Flag &flag = flags[t];
-      auto &f = poly.faces[i];
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {fl + 1, 0, fl, 5 * fl};
+    });
+
+    Thread(poly.n_faces).run([&flag, &poly, &centers](int i) {
+      auto fs = flag.slots(i);
+      auto f = poly.faces[i];
       auto flen = f.size();
 
       auto v1 = f[flen - 2], v2 = f[flen - 1]; //  [v1, v2,f.slice(-2);
 
-      flag.add_vertex(i4('cntr', i), centers[i]);
+      fs.add_vertex(key(Tag::cntr, i), centers[i]);
 
       for (size_t j = 0; j < flen; j++) {
-        auto sv1 = str(v1), sv2 = str(v2), si = str(i);
-        auto v = f[j];
-        auto v3 = v;
-        auto sv3 = str(v3);
+        auto v3 = f[j];
 
-        flag.add_vertex(
-            i4(v1, v2),
+        fs.add_vertex(
+            key(v1, v2),
             oneThird(poly.vertexes[v1], poly.vertexes[v2])); // new v in face
 
         // 5 new faces
-        flag.add_face(
-            {i4('cntr', i), i4(v1, v2), i4(v2, v1), i4(v2), i4(v2, v3)});
+        fs.add_face({key(Tag::cntr, i), key(v1, v2), key(v2, v1), key(v2),
+                     key(v2, v3)});
 
         // shift over one
         v1 = v2;
@@ -181,9 +208,9 @@ public:
       }
     });
 
-    flag.combine(flags);
+    flag.combine();
 
-    return {"g" + poly.name, flag.vertexes, flag.faces};
+    return {"g" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Propellor
@@ -195,22 +222,26 @@ public:
   static Polyhedron propellor(Polyhedron &poly) {
 
     Flag flag(poly.vertexes);
-    vector<Flag> flags(Thread::getnthreads()); // one flag per thread
 
-    Thread(poly.n_faces).run([&flags, &poly](int t, int i) {
-      Flag &flag = flags[t];
-      auto &f = poly.faces[i];
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {fl, fl, fl, 4 * fl};
+    });
+
+    Thread(poly.n_faces).run([&flag, &poly](int i) {
+      auto fs = flag.slots(i);
+      auto f = poly.faces[i];
       auto flen = f.size();
       auto v1 = f[flen - 2], v2 = f[flen - 1]; //  [v1, v2,f.slice(-2);
 
       for (auto v3 : f) {
-        flag.add_vertex(
-            i4(v1, v2),
+        fs.add_vertex(
+            key(v1, v2),
             oneThird(poly.vertexes[v1],
                      poly.vertexes[v2])); // new v in face, 1/3rd along edge
 
-        flag.add_face(i4(i), i4(v1, v2), i4(v2, v3)); // five new flags
-        flag.add_face({i4(v1, v2), i4(v2, v1), i4(v2), i4(v2, v3)});
+        fs.add_face(key(i), key(v1, v2), key(v2, v3)); // five new flags
+        fs.add_face({key(v1, v2), key(v2, v1), key(v2), key(v2, v3)});
 
         // shift over one
         v1 = v2;
@@ -218,8 +249,8 @@ public:
       }
     });
 
-    flag.combine(flags);
-    return {"p" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"p" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Reflection
@@ -236,6 +267,7 @@ public:
       reverse(poly.faces[i].begin(), poly.faces[i].end());
     });
 
+    poly.invalidate(); // edited in place
     poly.name = "r" + poly.name;
     return poly;
   }
@@ -252,29 +284,35 @@ public:
   // centroids.
   //
   static Polyhedron dual(Polyhedron &poly) {
+    auto &he = poly.get_halfedges();
+    return he.closed ? dual_direct(poly, he) : dual_flag(poly);
+  }
 
-    auto face_map = Flag::gen_face_map(poly);
-    auto centers = poly.get_centers();
-    vector<Flag> flags(Thread::getnthreads()); // one flag per thread
+  static Polyhedron dual_flag(Polyhedron &poly) {
 
-    Thread(poly.n_faces)
-        .run([&flags, &centers, &face_map, &poly](int t, int i) {
-          Flag &flag = flags[t];
-          auto &f = poly.faces[i];
-          auto v1 = f.back(); // previous vertex
-          flag.add_vertex(i4(i), centers[i]);
-          for (auto v2 : f) {
-            flag.add_face(i4(v1), Flag::Int4int::find(face_map, i4(v2, v1)),
-                          i4(i));
-            v1 = v2; // current becomes previous
-          }
-        });
+    auto &he = poly.get_halfedges(); // face across each edge: its twin's
+    auto &centers = poly.get_centers();
+    Flag flag;
 
-    auto &pn = poly.name;
-    auto name = (pn[0] != 'd') ? "d" + pn : pn.substr(1, string::npos);
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      return {1, int(poly.faces[i].size())};
+    });
+
+    Thread(poly.n_faces).run([&flag, &centers, &he, &poly](int i) {
+      auto fs = flag.slots(i);
+      fs.add_vertex(key(i), centers[i]);
+      for (int p = poly.faces.offsets[i]; p < poly.faces.offsets[i + 1]; p++)
+        fs.add_face(key(he.from(p)),
+                    key(he.twin[p] != -1 ? he.face[he.twin[p]] : i), key(i));
+    });
 
-    Flag flag(flags);
-    return {name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {dual_name(poly), std::move(flag.vertexes), std::move(flag.faces)};
+  }
+
+  static string dual_name(Polyhedron &poly) { // dd cancels
+    auto &pn = poly.name;
+    return (pn[0] != 'd') ? "d" + pn : pn.substr(1, string::npos);
   }
 
   // Chamfer
@@ -299,43 +337,47 @@ public:
 
   static Polyhedron chamfer(Polyhedron &poly, float dist = 0.05) {
 
-    int nth = Thread::getnthreads();
-    vector<Flag> flags(nth);
-    auto normals = poly.get_normals();
+    Flag flag;
+    auto &normals = poly.get_normals();
+
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {2 * fl, 4 * fl};
+    });
 
     // For each face f in the original poly
-    Thread(poly.n_faces).run([&poly, &flags, dist, &normals](int t, int i) {
-      auto &flag = flags[t];
-      auto &f = poly.faces[i];
+    Thread(poly.n_faces).run([&poly, &flag, dist, &normals](int i) {
+      auto fs = flag.slots(i);
+      auto f = poly.faces[i];
       auto v1 = f.back();
-      auto v1new = i4(i, v1);
+      auto v1new = key(i, v1);
 
       for (auto &v2 : f) {
         // TODO: figure out what distances will give us a planar hex face.
         // Move each old vertex further from the origin.
-        flag.add_vertex(i4(v2), (1.0f + dist) * poly.vertexes[v2]);
+        fs.add_vertex(key(v2), (1.0f + dist) * poly.vertexes[v2]);
         // Add a new vertex, moved parallel to normal.
-        auto v2new = i4(i, v2);
+        auto v2new = key(i, v2);
 
-        flag.add_vertex(v2new, poly.vertexes[v2] + (dist * 1.5f * normals[i]));
+        fs.add_vertex(v2new, poly.vertexes[v2] + (dist * 1.5f * normals[i]));
 
         // Four new flags:
         // One whose face corresponds to the original face:
-        flag.add_face(i4('orig', i), v1new, v2new);
+        fs.add_face(key(Tag::orig, i), v1new, v2new);
 
         // And three for the edges of the new hexagon:
-        auto facename = v1 < v2 ? i4('hex', v1, v2) : i4('hex', v2, v1);
-        flag.add_face(facename, i4(v2), v2new);
-        flag.add_face(facename, v2new, v1new);
-        flag.add_face(facename, v1new, i4(v1));
+        auto facename = key_min(Tag::hex, v1, v2);
+        fs.add_face(facename, key(v2), v2new);
+        fs.add_face(facename, v2new, v1new);
+        fs.add_face(facename, v1new, key(v1));
 
         v1 = v2;
         v1new = v2new;
       }
     });
 
-    Flag flag(flags);
-    return {"c" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"c" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Whirl
@@ -352,16 +394,19 @@ public:
   static Polyhedron whirl(Polyhedron &poly, int n = 0) {
     (void)n;
 
-    int nth = Thread::getnthreads();
-    vector<Flag> flags(nth);
     Flag flag(poly.vertexes);
 
     // new vertices around center of each face
-    auto centers = poly.get_centers();
+    auto &centers = poly.get_centers();
+
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {2 * fl, fl, fl, 6 * fl};
+    });
 
-    Thread(poly.n_faces).run([&poly, &flags, &centers](int t, int i) {
-      auto &flag = flags[t];
-      auto &f = poly.faces[i];
+    Thread(poly.n_faces).run([&poly, &flag, &centers](int i) {
+      auto fs = flag.slots(i);
+      auto f = poly.faces[i];
       auto flen = f.size();
       auto v1 = f[flen - 2], v2 = f[flen - 1]; //  [v1, v2,f.slice(-2);
 
@@ -371,29 +416,29 @@ public:
 
         // New vertex along edge
         auto v1_2 = oneThird(poly.vertexes[v1], poly.vertexes[v2]);
-        flag.add_vertex(i4(v1, v2), v1_2);
+        fs.add_vertex(key(v1, v2), v1_2);
         // New vertices near center of face
 
-        auto cv1name = i4('cntr', i, v1);
-        auto cv2name = i4('cntr', i, v2);
+        auto cv1name = key(Tag::cntr, i, v1);
+        auto cv2name = key(Tag::cntr, i, v2);
 
-        flag.add_vertex(cv1name, unit(oneThird(centers[i], v1_2)));
+        fs.add_vertex(cv1name, unit(oneThird(centers[i], v1_2)));
 
         //        auto fname = i4(i, 'f', v1);
         // New hexagon for each original edge
-        flag.add_face(
-            {cv1name, i4(v1, v2), i4(v2, v1), i4(v2), i4(v2, v3), cv2name});
+        fs.add_face(
+            {cv1name, key(v1, v2), key(v2, v1), key(v2), key(v2, v3), cv2name});
 
         // New face in center of each old face
-        flag.add_face(i4('c', i), cv1name, cv2name);
+        fs.add_face(key(Tag::c, i), cv1name, cv2name);
 
         v1 = v2; // shift over one
         v2 = v3;
       }
     });
 
-    flag.combine(flags);
-    return {"w" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"w" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Quinto
@@ -402,40 +447,48 @@ public:
   // one new inset face.
   static Polyhedron quinto(Polyhedron &poly) {
 
-    vector<Flag> flags(Thread::getnthreads());
+    Flag flag;
+
+    auto &centers = poly.get_centers();
 
-    auto centers = poly.get_centers();
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {3 * fl, 0, fl + 1, 6 * fl};
+    });
 
-    Thread(poly.n_faces).run([&flags, &poly, &centers](int t, int nface) {
-      Flag &flag = flags[t];
+    Thread(poly.n_faces, [&poly](int f) { return int(poly.faces[f].size()); })
+        .run([&flag, &poly, &centers](int nface) {
+      auto fs = flag.slots(nface);
 
       // For each face f in the original poly
 
-      auto &f = poly.faces[nface];
+      auto f = poly.faces[nface];
       auto flen = f.size();
       auto &centroid = centers[nface];
 
       // walk over face vertex-triplets
       auto v1 = f[flen - 2], v2 = f[flen - 1]; //  [v1, v2,f.slice(-2);
 
-      vector<Int4> vi4;
+      vector<Key> vi4;
       for (auto v3 : f) {
-        auto t12 = i4_min(v1, v2), ti12 = i4_min(nface, v1, v2),
-             t23 = i4_min(v2, v3), ti23 = i4_min(nface, v2, v3), iv2 = i4(v2);
+        // inner points are named by the directed edge, unique to this face
+        auto t12 = key_min(v1, v2), ti12 = key(Tag::inner, v1, v2),
+             t23 = key_min(v2, v3), ti23 = key(Tag::inner, v2, v3),
+             iv2 = key(v2);
 
         // for each face-corner, we make two new points:
         Vertex midpt = midpoint(poly.vertexes[v1], poly.vertexes[v2]),
                innerpt = midpoint(midpt, centroid);
 
-        flag.add_vertex(t12, midpt);
-        flag.add_vertex(ti12, innerpt);
+        fs.add_vertex(t12, midpt);
+        fs.add_vertex(ti12, innerpt);
 
         // and add the old corner-vertex
-        flag.add_vertex(iv2, poly.vertexes[v2]);
+        fs.add_vertex(iv2, poly.vertexes[v2]);
 
         // pentagon for each vertex in original face
 
-        flag.add_face({ti12, t12, iv2, t23, ti23});
+        fs.add_face({ti12, t12, iv2, t23, ti23});
 
         // inner rotated face of same vertex-number as original
         vi4.push_back(ti12);
@@ -444,13 +497,11 @@ public:
         v1 = v2;
         v2 = v3;
       }
-      flag.add_face(vi4);
+      fs.add_face(vi4);
     });
 
-    //    Flag flag(flags);
-    Flag flag;
-    flag.combine(flags);
-    return {"q" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"q" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // inset / extrude / "Loft" operator
@@ -459,16 +510,22 @@ public:
                            float popout_dist = -0.1f) {
 
     Flag flag(poly.vertexes);
-    vector<Flag> flags(Thread::getnthreads());
 
-    auto normals = poly.get_normals();
-    auto centers = poly.get_centers();
+    auto &normals = poly.get_normals();
+    auto &centers = poly.get_centers();
+
+    flag.alloc(poly.n_faces, [&poly, n](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      if (fl == n || n == 0)
+        return {fl, fl, fl, 4 * fl};
+      return {0, fl};
+    });
 
     bool foundAny = false; // alert if don't find any
     Thread(poly.n_faces)
-        .run([&flags, &poly, &foundAny, inset_dist, popout_dist, &centers, n,
-              &normals](int t, int i) {
-          Flag &flag = flags[t];
+        .run([&flag, &poly, &foundAny, inset_dist, popout_dist, &centers, n,
+              &normals](int i) {
+          auto fs = flag.slots(i);
           auto f = poly.faces[i];
           auto v1 = f.back();
 
@@ -478,15 +535,18 @@ public:
             if (f.size() == n || n == 0) {
               foundAny = true;
 
-              flag.add_vertex(i4('f', i, v),
-                              tween(poly.vertexes[v], centers[i], inset_dist) +
-                                  (popout_dist * normals[i]));
+              fs.add_vertex(key(Tag::f, i, v),
+                            tween(poly.vertexes[v], centers[i], inset_dist) +
+                                (popout_dist * normals[i]));
 
-              flag.add_face({i4(v1), i4(v2), i4('f', i, v2), i4('f', i, v1)});
+              fs.add_face({key(v1), key(v2), key(Tag::f, i, v2),
+                           key(Tag::f, i, v1)});
               // new inset, extruded face
-              flag.add_face(i4('ex', i), i4('f', i, v1), i4('f', i, v2));
+              fs.add_face(key(Tag::ex, i), key(Tag::f, i, v1),
+                          key(Tag::f, i, v2));
             } else {
-              flag.add_face(i4(i), i4(v1), i4(v2)); // same old flag, if non-n
+              fs.add_face(key(i), key(v1),
+                          key(v2)); // same old flag, if non-n
             }
 
             v1 = v2; // current becomes previous
@@ -496,8 +556,9 @@ public:
     if (!foundAny)
       printf("No %d - fold components were found.", n);
 
-    flag.combine(flags);
-    return {"n" + (n ? str(n) : "") + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"n" + (n ? str(n) : "") + poly.name, std::move(flag.vertexes),
+            std::move(flag.faces)};
   }
 
   // extrudeN
@@ -524,76 +585,83 @@ public:
                            float thickness = 0.1) {
 
     Flag flag(poly.vertexes);
-    vector<Flag> flags(Thread::getnthreads());
 
     auto normals = poly.avg_normals();
-    auto centers = poly.get_centers();
+    auto &centers = poly.get_centers();
 
-    Thread(poly.n_faces)
-        .run([&flags, &poly, inset_dist, thickness, &centers, &normals](int t,
-                                                                        int i) {
-          Flag &flag = flags[t];
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {2 * fl, 0, 2 * fl, 8 * fl};
+    });
+
+    Thread(poly.n_faces, [&poly](int f) { return int(poly.faces[f].size()); })
+        .run([&flag, &poly, inset_dist, thickness, &centers, &normals](int i) {
+          auto fs = flag.slots(i);
           auto v1 = poly.faces[i].back();
 
           for (auto &v2 : poly.faces[i]) {
             // new inset vertex for every vert in face
-            flag.add_vertex(i4('fin', i, 'v', v2),
-                            tween(poly.vertexes[v2], centers[i], inset_dist));
-            flag.add_vertex(i4('fdwn', i, 'v', v2),
-                            tween(poly.vertexes[v2], centers[i], inset_dist) -
-                                (thickness * normals[i]));
+            fs.add_vertex(key(Tag::fin, i, v2),
+                          tween(poly.vertexes[v2], centers[i], inset_dist));
+            fs.add_vertex(key(Tag::fdwn, i, v2),
+                          tween(poly.vertexes[v2], centers[i], inset_dist) -
+                              (thickness * normals[i]));
 
-            flag.add_face(
-                {i4(v1), i4(v2), i4('fin', i, 'v', v2), i4('fin', i, 'v', v1)});
+            fs.add_face(
+                {key(v1), key(v2), key(Tag::fin, i, v2), key(Tag::fin, i, v1)});
 
-            flag.add_face({i4('fin', i, 'v', v1), i4('fin', i, 'v', v2),
-                           i4('fdwn', i, 'v', v2), i4('fdwn', i, 'v', v1)});
+            fs.add_face({key(Tag::fin, i, v1), key(Tag::fin, i, v2),
+                         key(Tag::fdwn, i, v2), key(Tag::fdwn, i, v1)});
             v1 = v2; // current becomes previous
           }
         });
 
-    flag.combine(flags);
-    return {"H" + poly.name, flag.vertexes, flag.faces};
+    flag.combine();
+    return {"H" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
   }
 
   // Perspectiva 1
   // ------------------------------------------------------------------------------------------
   // an operation reverse-engineered from Perspectiva Corporum Regularium
   static Polyhedron perspectiva1(Polyhedron &poly) {
-    auto centers = poly.get_centers(); // calculate face centers
+    auto &centers = poly.get_centers(); // calculate face centers
 
     Flag flag;
-    vector<Flag> flags(Thread::getnthreads());
     flag.set_vertexes(poly.vertexes);
 
+    flag.alloc(poly.n_faces, [&poly](int i) -> Flag::Count {
+      int fl = poly.faces[i].size();
+      return {fl, 0, 2 * fl + 1, 7 * fl};
+    });
+
     // iterate over triplets of faces v1,v2,v3
-    Thread(poly.n_faces).run([&flags, &poly, &centers](int t, int i) {
-      Flag &flag = flags[t];
-      auto &f = poly.faces[i];
+    Thread(poly.n_faces).run([&flag, &poly, &centers](int i) {
+      auto fs = flag.slots(i);
+      auto f = poly.faces[i];
       auto flen = f.size();
       auto v1 = f[flen - 2], v2 = f[flen - 1];
       auto vert1 = poly.vertexes[v1], vert2 = poly.vertexes[v2];
 
-      vector<Int4> vi4;
+      vector<Key> vi4;
       for (auto &v3 : f) {
 
         auto vert3 = poly.vertexes[v3];
-        auto v12 = i4(v1, v2); // names for "oriented" midpoints
-        auto v21 = i4(v2, v1);
-        auto v23 = i4(v2, v3);
+        auto v12 = key(v1, v2); // names for "oriented" midpoints
+        auto v21 = key(v2, v1);
+        auto v23 = key(v2, v3);
 
         // on each Nface, N new points inset from edge midpoints towards
         // center = "stellated" points
-        flag.add_vertex(v12, midpoint(midpoint(vert1, vert2), centers[i]));
+        fs.add_vertex(v12, midpoint(midpoint(vert1, vert2), centers[i]));
 
         // inset Nface made of new, stellated points
         vi4.push_back(v12);
 
         // new tri face constituting the remainder of the stellated Nface
-        flag.add_face({v23, v12, i4(v2)});
+        fs.add_face({v23, v12, key(v2)});
 
         // one of the two new triangles replacing old edge between v1->v2
-        flag.add_face({i4(v1), v21, v12});
+        fs.add_face({key(v1), v21, v12});
 
         v1 = v2;
         v2 = v3; //  [v1, v2,[v2, v3];  // current becomes previous
@@ -601,23 +669,545 @@ public:
         vert1 = vert2;
         vert2 = vert3; // [vert1, vert2,[vert2, vert3];
       }
-      flag.add_face(vi4);
+      fs.add_face(vi4);
+    });
+
+    flag.combine();
+    return {"P" + poly.name, std::move(flag.vertexes), std::move(flag.faces)};
+  }
+
+  //===================================================================================================
+  // Direct kernels
+  //===================================================================================================
+  // kis, ambo and dual connectivity follows from the faces and the half-edge
+  // twins, so they are built straight into the output arrays, no keys, no
+  // sort. the vertexes and faces come out in the same order the flag
+  // versions give (key order, faces walked from the successor of their min
+  // index), so both are interchangeable
+
+  // vertexes: the used ones, by index (key(v)), then one apex per kis'ed
+  // face (Tag::f); faces: per face, one triangle per corner or itself
+  static Polyhedron kisN_direct(Polyhedron &poly, int n = 0,
+                                float apexdist = 0.1f) {
+    auto &normals = poly.get_normals();
+    auto &centers = poly.get_centers();
+    int nv = poly.n_vertex, nf = poly.n_faces;
+    auto kis = [&poly, n](int f) {
+      return n == 0 || int(poly.faces[f].size()) == n;
+    };
+
+    vector<int> vix(nv + 1, 0); // prefix of used: new index of v
+    for (auto v : poly.faces.indexes)
+      vix[v + 1] = 1;
+    for (int v = 0; v < nv; v++)
+      vix[v + 1] += vix[v];
+    int nu = vix[nv];
+
+    vector<int> apex(nf + 1, 0), sizes; // apex: prefix of kis'ed faces
+    for (int f = 0; f < nf; f++) {
+      int fl = poly.faces[f].size();
+      apex[f + 1] = apex[f] + kis(f);
+      if (kis(f))
+        sizes.insert(sizes.end(), fl, 3);
+      else
+        sizes.push_back(fl);
+    }
+
+    Vertexes vertexes(nu + apex[nf]);
+    Thread(nv).run([&poly, &vix, &vertexes](int v) {
+      if (vix[v + 1] != vix[v]) // used
+        vertexes[vix[v]] = poly.vertexes[v];
+    });
+
+    Faces faces(sizes);
+    vector<int> fo(nf); // first new face of face f
+    for (int f = 0, o = 0; f < nf; f++)
+      fo[f] = o, o += kis(f) ? poly.faces[f].size() : 1;
+
+    Thread(nf).run([&](int f) {
+      auto face = poly.faces[f];
+      int fl = face.size();
+      if (!kis(f)) {
+        auto nface = faces[fo[f]];
+        for (int j = 0; j < fl; j++)
+          nface[j] = vix[face[j]];
+        return;
+      }
+      int ia = nu + apex[f];
+      vertexes[ia] = centers[f] + (normals[f] * apexdist); // raised center
+      for (int j = 0, v1 = face.back(); j < fl; v1 = face[j++]) {
+        auto tri = faces[fo[f] + j];
+        tri[0] = vix[v1], tri[1] = vix[face[j]], tri[2] = ia;
+      }
+    });
+
+    return {"k" + (n ? str(n) : "") + poly.name, std::move(vertexes),
+            std::move(faces)};
+  }
+
+  // vertexes: one per edge a-b (a < b), numbered by (a, b) as key_min does;
+  // faces: one per used vertex, of the edges around it, then the original
+  // faces made of the edges of their corners
+  static Polyhedron ambo_direct(Polyhedron &poly, const HalfEdges &he) {
+    int nf = poly.n_faces;
+
+    vector<int> edge;
+    auto vertexes = edge_midpoints(poly, he, edge);
+
+    auto vs = he.used_vertexes();
+    vector<int> sizes; // vertex faces, then the original ones
+    for (auto v : vs)
+      sizes.push_back(he.degree(v));
+    int nvf = vs.size();
+    for (int f = 0; f < nf; f++)
+      sizes.push_back(poly.faces[f].size());
+
+    Faces faces(sizes);
+    if (!walk_faces(he, vs, faces, [&edge](int q, int *o) { *o = edge[q]; }))
+      return ambo_flag(poly);
+
+    Thread(nf).run([&poly, &faces, &edge, nvf](int f) {
+      auto face = faces[nvf + f];
+      int b = poly.faces.offsets[f], fl = face.size();
+      for (int k = 0; k < fl; k++) // corner k: edge from the previous one
+        face[k] = edge[b + (k + fl - 1) % fl];
+    });
+
+    return {"a" + poly.name, std::move(vertexes), std::move(faces)};
+  }
+
+  // edge[p]: number of the edge of half-edge p, by (a, b) a < b, returns
+  // their midpoints
+  static Vertexes edge_midpoints(Polyhedron &poly, const HalfEdges &he,
+                                 vector<int> &edge) {
+    int nv = poly.n_vertex;
+
+    vector<int> e_offsets(nv + 1, 0); // edges a->b of a with a < b
+    Thread(nv).run([&he, &e_offsets](int a) {
+      for (int i = he.out_offsets[a]; i < he.out_offsets[a + 1]; i++)
+        e_offsets[a + 1] += he.to(he.out[i]) > a;
+    });
+    for (int a = 0; a < nv; a++)
+      e_offsets[a + 1] += e_offsets[a];
+
+    edge.resize(poly.faces.n_indexes());
+    Vertexes mids(e_offsets[nv]);
+    Thread(nv).run([&poly, &he, &e_offsets, &edge, &mids](int a) {
+      int b0 = he.out_offsets[a], b1 = he.out_offsets[a + 1];
+      for (int i = b0; i < b1; i++) {
+        int p = he.out[i], b = he.to(p), e = e_offsets[a];
+        if (b <= a)
+          continue;
+        for (int j = b0; j < b1; j++) { // rank of b among a's
+          int c = he.to(he.out[j]);
+          e += c > a && c < b;
+        }
+        edge[p] = edge[he.twin[p]] = e;
+        mids[e] = midpoint(poly.vertexes[a], poly.vertexes[b]);
+      }
+    });
+    return mids;
+  }
+
+  // vertexes: the face centers; faces: one per used vertex, of the faces
+  // around it
+  static Polyhedron dual_direct(Polyhedron &poly, const HalfEdges &he) {
+    auto vs = he.used_vertexes();
+    vector<int> sizes;
+    for (auto v : vs)
+      sizes.push_back(he.degree(v));
+
+    Faces faces(sizes);
+    if (!walk_faces(he, vs, faces, [&he](int q, int *o) { *o = he.face[q]; }))
+      return dual_flag(poly);
+
+    return {dual_name(poly), poly.get_centers(), std::move(faces)};
+  }
+
+  // out[0..n) << value(q, out + k) (W values each) of the half-edges q
+  // leaving v, walked around it and rotated to end in the min value, as
+  // fill_m_faces traverses. false: v is not a single fan (non manifold)
+  template <int W = 1, class Value>
+  static bool walk_around(const HalfEdges &he, int v, int *out, int n,
+                          Value value) {
+    int q0 = he.out[he.out_offsets[v]], q = q0, k = 0;
+    for (; k < n && (k == 0 || q != q0); k += W, q = he.next_around(q))
+      value(q, out + k);
+    if (k < n || q != q0)
+      return false;
+    std::rotate(out, std::min_element(out, out + n) + 1, out + n);
+    return true;
+  }
+
+  template <int W = 1, class Value> // faces[i] << walk_around vs[i]
+  static bool walk_faces(const HalfEdges &he, vector<int> &vs, Faces &faces,
+                         Value value) {
+    std::atomic<bool> fan{true};
+    Thread(vs.size()).run([&he, &vs, &faces, &fan, value](int i) {
+      auto face = faces[i];
+      if (!walk_around<W>(he, vs[i], face.begin(), face.size(), value))
+        fan = false;
+    });
+    return fan;
+  }
+
+  //===================================================================================================
+  // Fused kernels
+  //===================================================================================================
+  // operator pairs built in one pass from the half-edges of the input, the
+  // intermediate polyhedron is never materialized. same vertexes and faces
+  // as the pair applied one after the other (Parser fuses them)
+
+  // dk: the dual of kis. kis turns half-edge p = u->v of face f into the
+  // triangle u, v, apex(f), so the new vertex p is its centroid; faces: per
+  // used vertex the triangles around it (two per face: in & out), then per
+  // original face its triangles
+  static Polyhedron truncate(Polyhedron &poly, float apexdist = 0.1f) {
+    auto &he = poly.get_halfedges();
+    if (!he.closed) {
+      auto kis = kisN(poly, 0, apexdist);
+      return dual(kis);
+    }
+
+    auto &normals = poly.get_normals();
+    auto &centers = poly.get_centers();
+    int nf = poly.n_faces;
+
+    Vertexes vertexes(poly.faces.n_indexes());
+    Thread(nf).run([&](int f) {
+      vec3 apex = centers[f] + (normals[f] * apexdist); // raised center
+      for (int p = poly.faces.offsets[f]; p < poly.faces.offsets[f + 1]; p++) {
+        vec3 c = 0; // summed as calc_centers does
+        c += poly.vertexes[he.from(p)];
+        c += poly.vertexes[he.to(p)];
+        c += apex;
+        vertexes[p] = c / 3.f;
+      }
+    });
+
+    auto vs = he.used_vertexes();
+    vector<int> sizes;
+    for (auto v : vs)
+      sizes.push_back(2 * he.degree(v));
+    int nvf = vs.size();
+    for (int f = 0; f < nf; f++)
+      sizes.push_back(poly.faces[f].size());
+
+    Faces faces(sizes);
+    if (!walk_faces<2>(he, vs, faces, [&he](int q, int *o) {
+          o[0] = he.prev(q), o[1] = he.next_around(q);
+        })) {
+      auto kis = kisN(poly, 0, apexdist);
+      return dual(kis);
+    }
+
+    Thread(nf).run([&poly, &faces, nvf](int f) { // b+1 .. b+fl-1, b
+      auto face = faces[nvf + f];
+      int b = poly.faces.offsets[f], fl = face.size();
+      for (int k = 0; k < fl; k++)
+        face[k] = b + (k + 1) % fl;
+    });
+
+    return {"dk" + poly.name, std::move(vertexes), std::move(faces)};
+  }
+
+  // da: the dual of ambo. ambo has a face per used vertex and per face, whose
+  // centroids are the new vertexes (summed in ambo's order); faces: a quad
+  // per edge a->b of f: f, a, twin face g, b
+  static Polyhedron join(Polyhedron &poly) {
+    auto &he = poly.get_halfedges();
+    if (!he.closed) {
+      auto ambo = PolyOperations::ambo(poly);
+      return dual(ambo);
+    }
+
+    int nv = poly.n_vertex, nf = poly.n_faces, ne = poly.faces.n_indexes();
+
+    vector<int> edge;
+    auto mids = edge_midpoints(poly, he, edge);
+
+    auto vs = he.used_vertexes();
+    int nvf = vs.size();
+    vector<int> vf(nv, -1); // ambo face of vertex v
+    for (int i = 0; i < nvf; i++)
+      vf[vs[i]] = i;
+
+    Vertexes vertexes(nvf + nf);
+    std::atomic<bool> fan{true};
+    Thread th(nvf);
+    vector<vector<int>> slot_edges(th.nth);
+    th.run([&](int t, int i) {
+      auto &es = slot_edges[t];
+      int v = vs[i], n = he.degree(v);
+      es.resize(n);
+      if (!walk_around(he, v, es.data(), n,
+                       [&edge](int q, int *o) { *o = edge[q]; }))
+        fan = false;
+      vec3 c = 0;
+      for (auto e : es)
+        c += mids[e];
+      vertexes[i] = c / float(n);
+    });
+    if (!fan) {
+      auto ambo = PolyOperations::ambo(poly);
+      return dual(ambo);
+    }
+
+    Thread(nf).run([&](int f) {
+      int b = poly.faces.offsets[f], fl = poly.faces.offsets[f + 1] - b;
+      vec3 c = 0;
+      for (int k = 0; k < fl; k++)
+        c += mids[edge[b + (k + fl - 1) % fl]];
+      vertexes[nvf + f] = c / float(fl);
+    });
+
+    Faces faces(vector<int>(mids.size(), 4));
+    Thread(ne).run([&](int p) {
+      int a = he.from(p), b = he.to(p);
+      if (a >= b)
+        return;
+      auto face = faces[edge[p]];
+      face[0] = nvf + he.face[p], face[1] = vf[a];
+      face[2] = nvf + he.face[he.twin[p]], face[3] = vf[b];
+      std::rotate(face.begin(), std::min_element(face.begin(), face.end()) + 1,
+                  face.end());
     });
 
-    flag.combine(flags);
-    return {"P" + poly.name, flag.vertexes, flag.faces};
+    return {"da" + poly.name, std::move(vertexes), std::move(faces)};
   }
 
   //===================================================================================================
-  // Goldberg-Coxeter Operators  (in progress...)
+  // Goldberg-Coxeter Operators
   //===================================================================================================
 
   // Triangular Subdivision Operator
   // ----------------------------------------------------------------------------------------------
   // limited version of the Goldberg-Coxeter u_n operator for triangular
-  // meshes We subdivide manually here, instead of using the usual flag
-  // machinery.
+  // meshes: each triangle into n^2. vertexes: the original ones, n - 1 per
+  // edge (slot k at k/n from the edge's first end), then (n-1)(n-2)/2
+  // inside each face. an edge point is computed once, from its edge, so
+  // the faces around it share it exactly: no string keys, no distance scan.
+  // point (i, j) of a face is v1 + i/n (v2 - v1) + j/n (v3 - v1), faces per
+  // input face as trisub_map. No-Op for non-triangular meshes.
   static Polyhedron trisub(Polyhedron &poly, int n = 2) {
+    for (size_t fn = 0; fn < poly.n_faces; fn++)
+      if (poly.faces[fn].size() != 3)
+        return poly;
+    n = std::max(n, 1);
+
+    auto &he = poly.get_halfedges();
+    int nv = poly.n_vertex, nf = poly.n_faces;
+
+    vector<int> edge, first; // edge of half-edge, its owner
+    int ne = number_edges(he, edge, first), per_face = (n - 1) * (n - 2) / 2;
+    int e_base = nv, f_base = nv + ne * (n - 1);
+
+    Vertexes vertexes(f_base + nf * per_face);
+    std::copy(poly.vertexes.begin(), poly.vertexes.end(), vertexes.begin());
+    Thread(ne).run([&poly, &he, &first, &vertexes, n, e_base](int e) {
+      vec3 a = poly.vertexes[he.from(first[e])],
+           ab = poly.vertexes[he.to(first[e])] - a;
+      for (int k = 1; k < n; k++)
+        vertexes[e_base + e * (n - 1) + k - 1] = a + (float(k) / n) * ab;
+    });
+
+    // vertex of point k (0..n) from the start of half-edge p
+    auto on_edge = [&he, &edge, &first, n, e_base](int p, int k) {
+      if (k == 0)
+        return he.from(p);
+      if (k == n)
+        return he.to(p);
+      int e = edge[p];
+      return e_base + e * (n - 1) + (first[e] == p ? k : n - k) - 1;
+    };
+
+    Faces faces(vector<int>(size_t(nf) * n * n, 3));
+    Thread(nf).run([&poly, &faces, &vertexes, &on_edge, n, per_face,
+                    f_base](int fn) {
+      int p0 = poly.faces.offsets[fn]; // p0: v3->v1, p0+1: v1->v2, v2->v3
+      auto f = poly.faces[fn];
+      vec3 v1 = poly.vertexes[f[0]], v21 = poly.vertexes[f[1]] - v1,
+           v31 = poly.vertexes[f[2]] - v1;
+      int base = f_base + fn * per_face;
+
+      auto point = [&](int i, int j) { // (i, j), i + j <= n
+        if (j == 0)
+          return on_edge(p0 + 1, i);
+        if (i == 0)
+          return on_edge(p0, n - j);
+        if (i + j == n)
+          return on_edge(p0 + 2, j);
+        return base + (i - 1) * (n - 1) - (i - 1) * i / 2 + j - 1;
+      };
+
+      for (int i = 1; i < n; i++) // interior points
+        for (int j = 1; i + j < n; j++)
+          vertexes[point(i, j)] =
+              (v1 + (float(i) / n) * v21) + (float(j) / n) * v31;
+
+      int t = fn * n * n;
+      for (int i = 0; i < n; i++)
+        for (int j = 0; j + i < n; j++) {
+          auto face = faces[t++];
+          face[0] = point(i, j), face[1] = point(i + 1, j),
+          face[2] = point(i, j + 1);
+        }
+      for (int i = 1; i < n; i++)
+        for (int j = 0; j + i < n; j++) {
+          auto face = faces[t++];
+          face[0] = point(i, j), face[1] = point(i, j + 1),
+          face[2] = point(i - 1, j + 1);
+        }
+    });
+
+    return {"u" + str(n) + poly.name, std::move(vertexes), std::move(faces)};
+  }
+
+  // edges numbered by their owner: a half-edge without a (mutual) twin, or
+  // the first of the pair. edge[p]: edge of half-edge p, first[e]: owner of
+  // edge e. returns the # of edges
+  static int number_edges(const HalfEdges &he, vector<int> &edge,
+                          vector<int> &first) {
+    int nh = he.face.size();
+    edge.assign(nh, -1), first.clear();
+    for (int p = 0; p < nh; p++)
+      if (owns(he, p)) {
+        edge[p] = first.size();
+        first.push_back(p);
+      }
+    Thread(nh).run([&he, &edge](int p) {
+      if (edge[p] == -1)
+        edge[p] = edge[he.twin[p]];
+    });
+    return first.size();
+  }
+  static bool owns(const HalfEdges &he, int p) {
+    int q = he.twin[p];
+    return q == -1 || he.twin[q] != p || p < q;
+  }
+
+  // Goldberg-Coxeter GC(a, b)
+  // ----------------------------------------------------------------------------------------------
+  // each triangle into T = a^2 + ab + b^2 of the lattice of GCLattice:
+  // class I (b = 0, as trisub), II (a = b) and III (chiral). vertexes: the
+  // original ones, g - 1 per edge (from its owner, as trisub), then the
+  // inner points of each face. the small triangles across a side take their
+  // outer corners from the neighbor face, so classes II, III need a closed
+  // mesh. built in parallel per master face, faces in lattice order. sphere:
+  // vertexes projected to the unit sphere. No-Op for non-triangular meshes
+  static Polyhedron goldberg_coxeter(Polyhedron &poly, int a, int b,
+                                     bool sphere = false) {
+    for (size_t fn = 0; fn < poly.n_faces; fn++)
+      if (poly.faces[fn].size() != 3)
+        return poly;
+    a = std::max(a, 0), b = std::max(b, 0);
+    if (a + b == 0)
+      return poly;
+
+    GCLattice lat(a, b);
+    auto &he = poly.get_halfedges();
+    if (!lat.outs.empty() && !he.closed)
+      return poly;
+
+    int nv = poly.n_vertex, nf = poly.n_faces, g = lat.g;
+    vector<int> edge, first; // edge of half-edge, its owner
+    int ne = number_edges(he, edge, first), per_face = lat.inners.size();
+    int e_base = nv, f_base = nv + ne * (g - 1);
+
+    Vertexes vertexes(f_base + size_t(nf) * per_face);
+    std::copy(poly.vertexes.begin(), poly.vertexes.end(), vertexes.begin());
+    Thread(ne).run([&poly, &he, &first, &vertexes, g, e_base](int e) {
+      vec3 a = poly.vertexes[he.from(first[e])],
+           ab = poly.vertexes[he.to(first[e])] - a;
+      for (int k = 1; k < g; k++)
+        vertexes[e_base + e * (g - 1) + k - 1] = a + (float(k) / g) * ab;
+    });
+
+    // side s of face f: corner s -> s + 1, the half-edge that ends in s + 1
+    auto side = [&poly](int f, int s) {
+      return poly.faces.offsets[f] + (s + 1) % 3;
+    };
+    vector<int> fo(nf + 1, 0); // prefix of the triangles of each face
+    for (int f = 0; f < nf; f++) {
+      fo[f + 1] = fo[f] + lat.n_inside;
+      for (int s = 0; s < 3; s++)
+        fo[f + 1] += owns(he, side(f, s)) ? lat.n_on_side : 0;
+    }
+
+    // vertex of point k (0..g) from the start of half-edge p
+    auto on_edge = [&he, &edge, &first, g, e_base](int p, int k) {
+      if (k == 0)
+        return he.from(p);
+      if (k == g)
+        return he.to(p);
+      int e = edge[p];
+      return e_base + e * (g - 1) + (first[e] == p ? k : g - k) - 1;
+    };
+    // vertex of lattice point r of face f, out: a point of the neighbor
+    auto vertex = [&](int f, GCLattice::Ref r) {
+      if (r.kind == GCLattice::Ref::out) {
+        auto l = lat.outs[r.k];
+        for (int hop = 0; hop < 3 && r.kind == GCLattice::Ref::out; hop++) {
+          int q = he.twin[side(f, r.s)];
+          f = he.face[q];
+          l = GCLattice::across(l, r.s, (q - poly.faces.offsets[f] + 2) % 3);
+          r = lat.classify(l);
+        }
+      }
+      switch (r.kind) {
+      case GCLattice::Ref::corner:
+        return poly.faces[f][r.s];
+      case GCLattice::Ref::side:
+        return on_edge(side(f, r.s), r.k);
+      default:
+        return f_base + f * per_face + r.k;
+      }
+    };
+
+    Faces faces(vector<int>(fo[nf], 3));
+    Thread(nf).run([&](int f) {
+      auto face = poly.faces[f];
+      vec3 v0 = poly.vertexes[face[0]], v1 = poly.vertexes[face[1]],
+           v2 = poly.vertexes[face[2]];
+      for (int i = 0; i < per_face; i++) {
+        auto &w = lat.inners[i];
+        vertexes[f_base + f * per_face + i] = v0 * w[0] + v1 * w[1] + v2 * w[2];
+      }
+
+      int t = fo[f];
+      for (size_t i = 0; i < lat.triangles.size(); i++) {
+        int s = lat.on_side[i];
+        if (s != -1 && !owns(he, side(f, s)))
+          continue;
+        auto tri = faces[t++];
+        for (int j = 0; j < 3; j++)
+          tri[j] = vertex(f, lat.triangles[i][j]);
+      }
+    });
+
+    if (sphere)
+      to_sphere(vertexes);
+
+    return {string(sphere ? "S" : "") + "G" + str(a) + "," + str(b) +
+                poly.name,
+            std::move(vertexes), std::move(faces)};
+  }
+
+  // vertexes projected to the unit sphere (geodesic domes: Su4I, SG3,1I)
+  static Polyhedron spherize(Polyhedron &poly) {
+    auto vertexes = poly.vertexes;
+    to_sphere(vertexes);
+    return {"S" + poly.name, std::move(vertexes), poly.faces};
+  }
+  static void to_sphere(Vertexes &vertexes) {
+    Thread(vertexes.size()).run([&vertexes](int v) {
+      vertexes[v] = vec::normalize(vec3(vertexes[v]));
+    });
+  }
+
+  // trisub as it was ported: vertexes by string keys, merged by an all
+  // pairs distance scan (O(V^2)), for comparison
+  static Polyhedron trisub_map(Polyhedron &poly, int n = 2) {
 
     for (size_t fn = 0; fn < poly.n_faces;
          fn++) // No-Op for non-triangular meshes.
@@ -630,7 +1220,7 @@ public:
     int pos = 0;
 
     for (size_t fn = 0; fn < poly.faces.size(); fn++) {
-      auto &f = poly.faces[fn];
+      auto f = poly.faces[fn];
       auto flen = f.size();
       auto i1 = f[flen - 3], i2 = f[flen - 2],
            i3 = f[flen - 1]; // let [i1, i2, i3,f.slice(-3);
@@ -654,15 +1244,15 @@ public:
     Vertexes uniqVs;
     int newpos = 0;
     map<int, int> uniqmap;
-    int i = 0;
-    for (auto v : newVs) {
+    for (int i = 0; i < int(newVs.size()); i++) {
+      auto v = newVs[i];
       if (uniqmap.find(i) != uniqmap.end())
         continue; // already mapped
       uniqmap[i] = newpos;
       uniqVs.push_back(v);
       for (size_t j = i + 1; j < newVs.size(); j++) {
         auto w = newVs[j];
-        if (simd_distance(v, w) < EPSILON_CLOSE)
+        if (vec::distance(v, w) < EPSILON_CLOSE)
           uniqmap[int(j)] = newpos;
       }
       newpos++;
@@ -692,6 +1282,19 @@ public:
     // Create new polygon out of faces and unique vertices.
     return Polyhedron("u" + str(n) + poly.name, uniqVs, faces);
   }
+
+  // Canonicalize
+  // ------------------------------------------------------
+  // edges tangent to the unit sphere, centered on the origin, planar faces:
+  // same topology, vertexes iterated to tolerance, a stall or max_iter
+  // (Canonical::last() tells which), the lowest residual ones kept
+  static Polyhedron canonicalize(Polyhedron &poly,
+                                 int max_iter = Canonical::default_iter,
+                                 float tol = Canonical::default_tol) {
+    auto vertexes = poly.vertexes;
+    Canonical(poly.faces, poly.get_halfedges()).run(vertexes, max_iter, tol);
+    return {"K" + poly.name, std::move(vertexes), poly.faces};
+  }
 };
 
 #endif /* poly_operations_hpp */
@@ -44,7 +44,7 @@ public:
 
   Polyhedron topoly(string name="unknown polyhedron") {
     Vertexes vertexes(vertidxs.size());
-    Faces faces(flags.size());
+    vector<Face> faces(flags.size());
 
     int ctr = 0; // first number the vertices
     for (auto i : vertidxs) {
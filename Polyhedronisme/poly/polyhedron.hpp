@@ -10,15 +10,18 @@
 #define polyhedron_hpp
 
 #include "Thread.h"
+#include "area_classes.hpp"
 #include "color.hpp"
 #include "common.hpp"
+#include "face_kernels.hpp"
+#include "halfedges.hpp"
 
 class Polyhedron {
 public:
   Polyhedron() {}
-  Polyhedron(const string name, const Vertexes vertexes, const Faces faces)
-      : name(name), vertexes(vertexes), faces(faces), n_vertex(vertexes.size()),
-        n_faces(faces.size()) {}
+  Polyhedron(const string name, Vertexes vertexes, Faces faces) // moved in
+      : name(name), vertexes(std::move(vertexes)), faces(std::move(faces)),
+        n_vertex(this->vertexes.size()), n_faces(this->faces.size()) {}
 
   Polyhedron(const string name, const VertexesFloat vertexes,
              const vector<vector<int>> faces)
@@ -29,19 +32,48 @@ public:
       this->vertexes.push_back(Vertex{v[0], v[1], v[2]});
   }
 
-  Polyhedron recalc() {
-    calc_normals();
-    calc_areas();
-    calc_centers();
-    calc_colors();
+  Polyhedron &recalc() { // all attributes, the valid ones are kept
+    if (!(valid & (a_normals | a_centers | a_areas)))
+      calc_face_attrs(); // one pass for the three
+    get_normals();
+    get_areas();
+    get_centers();
+    get_colors();
     return *this;
   }
 
+  // attribute cache: each attribute is computed at most once per geometry
+  // version. set_vertexes, set_faces, replace and invalidate() (after
+  // editing vertexes / faces in place) drop them all
+  enum Attr {
+    a_normals = 1,
+    a_centers = 2,
+    a_areas = 4,
+    a_colors = 8,
+    a_halfedges = 16
+  };
+
+  struct AttrStats { // # of computations, all polyhedra
+    std::atomic<long> normals{0}, centers{0}, areas{0}, colors{0},
+        halfedges{0};
+    void reset() { normals = centers = areas = colors = halfedges = 0; }
+  };
+  static AttrStats &attr_stats() {
+    static AttrStats st;
+    return st;
+  }
+
+  void invalidate() {
+    valid = 0;
+    halfedges.reset();
+  }
+  bool is_valid(Attr a) const { return valid & a; }
+
   void scale_vertexes() {
     float min = __FLT_MAX__, max = -__FLT_MAX__;
     for (auto &v : vertexes) {
-      max = std::max(max, simd_reduce_max(v));
-      min = std::min(min, simd_reduce_min(v));
+      max = std::max(max, vec::reduce_max(v));
+      min = std::min(min, vec::reduce_min(v));
     }
     float diff = abs(max - min);
     if (diff != 0.f)
@@ -51,10 +83,12 @@ public:
 
   void calc_normals() { // per face
     normals = Vertexes(n_faces);
-    Thread(n_faces).run([this](int f) {
+    auto normal = [this](int f) {
       normals[f] = calc_normal(vertexes[faces[f][0]], vertexes[faces[f][1]],
                                vertexes[faces[f][2]]);
-    });
+    };
+    FaceKernels::run(vertexes, faces, normals.data(), nullptr, nullptr, normal);
+    computed(a_normals);
   }
 
   void calc_normals_st() { // per face
@@ -62,13 +96,11 @@ public:
     for (size_t f = 0; f < n_faces; f++)
       normals[f] = calc_normal(vertexes[faces[f][0]], vertexes[faces[f][1]],
                                vertexes[faces[f][2]]);
+    computed(a_normals);
   }
 
   int count_points() { // count # of vertex used in all faces
-    int np = 0;
-    for (auto &face : faces)
-      np += face.size();
-    return np;
+    return faces.n_indexes();
   }
 
   // calculate average normal vector for array of vertices
@@ -78,7 +110,8 @@ public:
     Thread(n_faces).run([this, &normals](int i) {
       size_t face_len = faces[i].size();
       Vertex normalV = 0;
-      auto v1 = vertexes[face_len - 2], v2 = vertexes[face_len - 1];
+      auto v1 = vertexes[faces[i][face_len - 2]],
+           v2 = vertexes[faces[i][face_len - 1]];
 
       for (auto ic : faces[i]) { // running sum of normal vectors
         auto v3 = vertexes[ic];
@@ -98,7 +131,8 @@ public:
 
       size_t face_len = faces[i].size();
       Vertex normalV = 0;
-      auto v1 = vertexes[face_len - 2], v2 = vertexes[face_len - 1];
+      auto v1 = vertexes[faces[i][face_len - 2]],
+           v2 = vertexes[faces[i][face_len - 1]];
 
       for (auto ic : faces[i]) { // running sum of normal vectors
         auto v3 = vertexes[ic];
@@ -114,141 +148,196 @@ public:
   void calc_centers() { // per face
     centers = Vertexes(n_faces);
     Thread(n_faces).run([this](int f) {
-      Vertex fcenter = 0;
-      Face face = faces[f];
+      vec3 fcenter = 0;
+      auto face = faces[f];
       // average vertex coords
       for (size_t ic = 0; ic < face.size(); ic++)
         fcenter += vertexes[face[ic]];
       centers[f] =
           fcenter / face.size(); //  return face - ordered array  of  centroids
     });
+    computed(a_centers);
   }
   void calc_centers_st() { // per face
     centers = Vertexes(n_faces);
     for (size_t f = 0; f < n_faces; f++) {
-      Vertex fcenter = 0;
-      Face face = faces[f];
+      vec3 fcenter = 0;
+      auto face = faces[f];
       // average vertex coords
       for (size_t ic = 0; ic < face.size(); ic++)
         fcenter += vertexes[face[ic]];
       centers[f] =
           fcenter / face.size(); //  return face - ordered array  of  centroids
     }
+    computed(a_centers);
   }
 
   void calc_areas() { // per face
+    get_normals(); // required
     areas = vector<float>(n_faces);
-    Thread(n_faces).run([this](int f) {
-      auto &face = faces[f];
-      simd_float3 vsum = 0;
+    auto area = [this](int f) {
+      auto face = faces[f];
+      vec3 vsum = 0;
       auto fl = face.size();
-      Vertex v1 = vertexes[face[fl - 2]], v2 = vertexes[face[fl - 1]];
+      vec3 v1 = vertexes[face[fl - 2]], v2 = vertexes[face[fl - 1]];
 
       for (size_t ic = 0; ic < fl; ic++) {
-        vsum += simd::cross(v1, v2);
+        vsum += vec::cross(v1, v2);
         v1 = v2;
         v2 = vertexes[face[ic]];
       }
-      areas[f] = abs(simd::dot(normals[f], vsum)) / 2;
-    });
+      areas[f] = abs(vec::dot(normals[f], vsum)) / 2;
+    };
+    FaceKernels::run(vertexes, faces, nullptr, nullptr, areas.data(), area);
+    computed(a_areas);
   }
   void calc_areas_st() { // per face
+    get_normals(); // required
     areas = vector<float>(n_faces);
     for (size_t f = 0; f < n_faces; f++) {
-      auto &face = faces[f];
-      simd_float3 vsum = 0;
+      auto face = faces[f];
+      vec3 vsum = 0;
       auto fl = face.size();
-      Vertex v1 = vertexes[face[fl - 2]], v2 = vertexes[face[fl - 1]];
+      vec3 v1 = vertexes[face[fl - 2]], v2 = vertexes[face[fl - 1]];
 
       for (size_t ic = 0; ic < fl; ic++) {
-        vsum += simd::cross(v1, v2);
+        vsum += vec::cross(v1, v2);
         v1 = v2;
         v2 = vertexes[face[ic]];
       }
-      areas[f] = abs(simd::dot(normals[f], vsum)) / 2;
+      areas[f] = abs(vec::dot(normals[f], vsum)) / 2;
     }
+    computed(a_areas);
   }
 
-  void calc_colors() { // per areas
-    calc_areas();      // areas required
+  // normals, centers & areas in one traversal of each face, same results as
+  // calc_normals, calc_centers, calc_areas: normal of the first 3 vertexes,
+  // centroid summed in order, area from the cross products of the edges.
+  // FaceKernels batches the small faces on avx2 builds
+  void calc_face_attrs() {
+    normals = Vertexes(n_faces);
+    centers = Vertexes(n_faces);
+    areas = vector<float>(n_faces);
+    auto attrs = [this](int f) {
+      auto face = faces[f];
+      auto fl = face.size();
+      vec3 fcenter = 0, vsum = 0;
+      vec3 v1 = vertexes[face[fl - 2]], v2 = vertexes[face[fl - 1]];
 
-    auto pallette = Color::random_pallete();
-    map<int, Vertex> color_dict; // color dict<sigfigs, pallette>
+      for (size_t ic = 0; ic < fl; ic++) {
+        vsum += vec::cross(v1, v2);
+        v1 = v2;
+        v2 = vertexes[face[ic]];
+        fcenter += v2;
+      }
+      normals[f] = calc_normal(vertexes[face[0]], vertexes[face[1]],
+                               vertexes[face[2]]); // in cache by now
+      centers[f] = fcenter / fl;
+      areas[f] = abs(vec::dot(normals[f], vsum)) / 2;
+    };
+    FaceKernels::run(vertexes, faces, normals.data(), centers.data(),
+                     areas.data(), attrs);
+    computed(a_normals);
+    computed(a_centers);
+    computed(a_areas);
+  }
 
-    for (auto a : areas) {
-      auto k = sigfigs(a);
-      if (color_dict.find(k) == color_dict.end()) // not found
-        color_dict[k] = pallette[color_dict.size() % pallette.size()];
-    }
-    colors.clear();
-    for (auto a : areas)
-      colors.push_back(color_dict[sigfigs(a)]);
+  void calc_colors() { // per areas, same color for the same 2 digits
+    get_areas();       // required
+
+    auto pallette = Color::random_pallete();
+    colors = Vertexes(n_faces);
+    AreaClasses::classify(areas, [this, &pallette](int f, int c) {
+      colors[f] = pallette[c % pallette.size()];
+    });
+    computed(a_colors);
   }
 
-  Vertex centroid(Face &face) {
-    Vertex centroid = 0; // calc centroid of face
+  Vertex centroid(Faces::const_face_ref face) {
+    vec3 centroid = 0; // calc centroid of face
     for (auto ic : face)
       centroid += vertexes[ic];
     return centroid /= face.size();
   }
 
   // sets
-  //  void set_faces(Faces &faces) {
-  //    this->faces = faces;
-  //    this->n_faces = faces.size();
-  //  }
-
-  // gets
-  string get_name() { return name; }
-  Vertexes get_vertexes() { return vertexes; }
-  Faces get_faces() { return faces; }
-  Vertexes get_normals() {
-    if (normals.empty())
+  void set_faces(Faces faces) {
+    this->faces = std::move(faces);
+    n_faces = this->faces.size();
+    invalidate();
+  }
+
+  // gets, computed on first use
+  const string &get_name() const { return name; }
+  const Vertexes &get_vertexes() const { return vertexes; }
+  const Faces &get_faces() const { return faces; }
+  const Vertexes &get_normals() {
+    if (!is_valid(a_normals))
       calc_normals();
     return normals;
   }
-  vector<float> get_areas() {
-    if (areas.empty())
+  const vector<float> &get_areas() {
+    if (!is_valid(a_areas))
       calc_areas();
     return areas;
   }
-  Vertexes get_centers() {
-    if (centers.empty())
+  const Vertexes &get_centers() {
+    if (!is_valid(a_centers))
       calc_centers();
     return centers;
   }
-  Vertexes get_colors() {
-    get_areas(); // required
-    if (colors.empty())
+  const Vertexes &get_colors() {
+    if (!is_valid(a_colors))
       calc_colors();
     return colors;
   }
+  const HalfEdges &get_halfedges() { // shared by the copies of this one
+    if (!is_valid(a_halfedges)) {
+      halfedges = std::make_shared<const HalfEdges>(faces, n_vertex);
+      computed(a_halfedges);
+    }
+    return *halfedges;
+  }
 
+  // per face, no computation: colors / normals must be valid (recalc)
   Vertex get_color(int face) { // get face color according to face area
     return colors[face];
   }
 
   Vertex get_normal(int face) { return normals[face]; }
 
-  void set_colors(Vertexes &colors) { this->colors = colors; }
+  void set_colors(Vertexes &colors) {
+    this->colors = colors;
+    valid |= a_colors;
+  }
 
-  void set_normals(Vertexes &normals) { this->normals = normals; }
+  void set_normals(Vertexes &normals) {
+    this->normals = normals;
+    valid |= a_normals;
+  }
 
   void set_vertexes(Vertexes &vertexes) {
     this->vertexes = vertexes;
     n_vertex = vertexes.size();
+    invalidate();
   }
 
   void replace(Vertexes vertexes, Vertexes normals, Vertexes colors) {
     this->vertexes = vertexes;
     n_vertex = vertexes.size();
+    invalidate();
     this->normals = normals;
     this->colors = colors;
+    valid = a_normals | a_colors;
   }
 
-  void new_colors() {
-    colors.clear();
-    calc_colors();
+  void new_colors() { calc_colors(); }
+
+  size_t bytes() const { // vertexes, faces & attributes
+    return (vertexes.size() + normals.size() + colors.size() + centers.size()) *
+               sizeof(Vertex) +
+           areas.size() * sizeof(float) + faces.bytes() +
+           (halfedges ? halfedges->bytes() : 0);
   }
 
   // print
@@ -317,25 +406,40 @@ public:
 private:
   Vertexes normals, colors, centers;
   vector<float> areas;
+  std::shared_ptr<const HalfEdges> halfedges; // immutable, faces own copy
+  unsigned valid = 0; // Attr bits
+
+  void computed(Attr a) { // valid & counted
+    valid |= a;
+    auto &st = attr_stats();
+    switch (a) {
+    case a_normals:
+      st.normals++;
+      break;
+    case a_centers:
+      st.centers++;
+      break;
+    case a_areas:
+      st.areas++;
+      break;
+    case a_colors:
+      st.colors++;
+      break;
+    case a_halfedges:
+      st.halfedges++;
+      break;
+    }
+  }
 
 private:
-  inline Vertex calc_normal(Vertex v0, Vertex v1, Vertex v2) {
-    return unit(simd::cross(v1 - v0, v2 - v1));
+  inline vec3 calc_normal(const vec3 &v0, const vec3 &v1, const vec3 &v2) {
+    return unit(vec::cross(v1 - v0, v2 - v1));
   }
-  inline Vertex normal(Vertex v0, Vertex v1, Vertex v2) {
-    return simd::cross(v1 - v0, v2 - v1);
+  inline vec3 normal(const vec3 &v0, const vec3 &v1, const vec3 &v2) {
+    return vec::cross(v1 - v0, v2 - v1);
   }
 
-  inline Vertex unit(const Vertex &v) { return simd::normalize(v); }
-
-  int sigfigs(
-      float f,
-      int nsigs = 2) { // returns string w. nsigs digits ignoring magnitude
-    if (f == 0.f)
-      return 0;
-    float mantissa = f / powf(10, floor(log10f(f)));
-    return int(roundf(mantissa * powf(10, (nsigs - 1))));
-  }
+  inline vec3 unit(const vec3 &v) { return vec::normalize(v); }
 };
 
 #endif /* polyhedron_hpp */
@@ -15,11 +15,11 @@
 class Seeds : public Polyhedron {
 public:
     static Polyhedron tetrahedron() {
-        return Polyhedron("T", {{1.0, 1.0, 1.0},  {1.0, -1.0, -1.0},  {-1.0, 1.0, -1.0}, {-1.0, -1.0, 1.0}},
+        return Polyhedron("T", Vertexes{{1.0, 1.0, 1.0},  {1.0, -1.0, -1.0},  {-1.0, 1.0, -1.0}, {-1.0, -1.0, 1.0}},
         {{0, 1, 2}, {0, 2, 3}, {0, 3, 1}, {1, 3, 2}});
     }
     static Polyhedron cube() {
-        return Polyhedron("C", {{0.707, 0.707, 0.707}, {-0.707, 0.707, 0.707},
+        return Polyhedron("C", Vertexes{{0.707, 0.707, 0.707}, {-0.707, 0.707, 0.707},
             {-0.707, -0.707, 0.707}, {0.707, -0.707, 0.707},
             {0.707, -0.707, -0.707}, {0.707, 0.707, -0.707},
             {-0.707, 0.707, -0.707}, {-0.707, -0.707, -0.707}},
@@ -27,7 +27,7 @@ public:
                               {2, 7, 4, 3}, {5, 4, 7, 6}  });
     }
     static Polyhedron icosahedron(){
-        return Polyhedron("I", {{0, 0, 1.176}, {1.051, 0, 0.526}, {0.324, 1.0, 0.525},
+        return Polyhedron("I", Vertexes{{0, 0, 1.176}, {1.051, 0, 0.526}, {0.324, 1.0, 0.525},
             {-0.851, 0.618, 0.526}, {-0.851, -0.618, 0.526}, {0.325, -1.0, 0.526},
             {0.851, 0.618, -0.526}, {0.851, -0.618, -0.526}, {-0.325, 1.0, -0.526},
             {-1.051, 0, -0.526}, {-0.325, -1.0, -0.526}, {0, 0, -1.176}
@@ -37,7 +37,7 @@ public:
             {8, 11, 9}, {9, 11, 10}});
     }
     static Polyhedron octahedron() {
-        return Polyhedron("O", {{0, 0, 1.414}, {1.414, 0, 0},
+        return Polyhedron("O", Vertexes{{0, 0, 1.414}, {1.414, 0, 0},
             {0, 1.414, 0}, {-1.414, 0, 0},
             {0, -1.414, 0}, {0, 0, -1.414}
         }, {{0, 1, 2}, {0, 2, 3}, {0, 3, 4}, {0, 4, 1},
@@ -45,7 +45,7 @@ public:
         });
     }
     static Polyhedron dodecahedron() {
-        return Polyhedron("D", {{0, 0, 1.07047}, {0.713644, 0, 0.797878}, {-0.356822, 0.618, 0.797878},
+        return Polyhedron("D", Vertexes{{0, 0, 1.07047}, {0.713644, 0, 0.797878}, {-0.356822, 0.618, 0.797878},
             {-0.356822, -0.618, 0.797878}, {0.797878, 0.618034, 0.356822}, {0.797878, -0.618, 0.356822},
             {-0.934172, 0.381966, 0.356822}, {0.136294, 1.0, 0.356822}, {0.136294, -1.0, 0.356822},
             {-0.934172, -0.381966, 0.356822}, {0.934172, 0.381966, -0.356822},
@@ -0,0 +1,230 @@
+//
+//  vec3.hpp
+//  test_polygon
+//
+//  portable 3d float vectors: float3 (packed storage, the Vertex type) and
+//  vec3 (compute) with their math. backend chosen at build time:
+//    avx2   -mavx2: the sse2 code, VEX encoded (one 3d vector has nothing
+//           for 256 bit lanes, no fma: all backends give the same bits)
+//    sse2   x86_64 default (__SSE2__)
+//    scalar anything else, or -DVEC3_SCALAR
+
+#ifndef vec3_hpp
+#define vec3_hpp
+
+#include <algorithm>
+#include <cmath>
+
+#if !defined(VEC3_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define VEC3_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(VEC3_SSE2) && defined(__AVX2__)
+#define VEC3_BACKEND "avx2"
+#elif defined(VEC3_SSE2)
+#define VEC3_BACKEND "sse2"
+#else
+#define VEC3_BACKEND "scalar"
+#endif
+
+struct vec3;
+
+// storage: packed x, y, z (r, g, b), 12 bytes, no pad. vertexes, normals,
+// colors & the gl buffers; converted to / from vec3 in registers
+struct float3 {
+  union {
+    struct {
+      float x, y, z;
+    };
+    struct {
+      float r, g, b;
+    };
+    float e[3];
+  };
+
+  inline float3() : x(0), y(0), z(0) {}
+  inline float3(float s) : x(s), y(s), z(s) {}
+  template <class A, class B, class C>
+  inline float3(A x, B y, C z) : x(float(x)), y(float(y)), z(float(z)) {}
+  inline float3(const vec3 &v);
+
+  inline float &operator[](int i) { return e[i]; }
+  inline const float &operator[](int i) const { return e[i]; }
+
+  inline float3 &operator+=(const vec3 &o);
+  inline float3 &operator-=(const vec3 &o);
+  inline float3 &operator*=(float s);
+  inline float3 &operator/=(float s);
+};
+
+static_assert(sizeof(float3) == 12, "float3: gl stride of packed xyz");
+
+// compute: 16 byte aligned, the 4th float is a pad kept 0. an __m128 on
+// sse2, so the math stays in registers
+struct alignas(16) vec3 {
+  union {
+    struct {
+      float x, y, z, w;
+    };
+    struct {
+      float r, g, b;
+    };
+    float e[4];
+#ifdef VEC3_SSE2
+    __m128 m;
+#endif
+  };
+
+  inline vec3() : vec3(0.f, 0.f, 0.f) {}
+  inline vec3(float s) : vec3(s, s, s) {}
+  template <class A, class B, class C> inline vec3(A x, B y, C z) {
+    set(float(x), float(y), float(z));
+  }
+  inline vec3(const float3 &p) { set(p.x, p.y, p.z); }
+#ifdef VEC3_SSE2
+  inline explicit vec3(__m128 m) : m(m) {}
+  inline void set(float x, float y, float z) {
+    m = _mm_setr_ps(x, y, z, 0.f);
+  }
+#else
+  inline void set(float x, float y, float z) {
+    this->x = x, this->y = y, this->z = z, w = 0;
+  }
+#endif
+
+  inline float &operator[](int i) { return e[i]; }
+  inline const float &operator[](int i) const { return e[i]; }
+
+  inline vec3 &operator+=(const vec3 &o);
+  inline vec3 &operator-=(const vec3 &o);
+  inline vec3 &operator*=(float s);
+  inline vec3 &operator/=(float s);
+};
+
+namespace vec {
+
+namespace scalar { // reference, always compiled
+static inline vec3 add(const vec3 &a, const vec3 &b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+static inline vec3 sub(const vec3 &a, const vec3 &b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+static inline vec3 mul(const vec3 &a, const vec3 &b) {
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+static inline vec3 mul(const vec3 &a, float s) {
+  return {a.x * s, a.y * s, a.z * s};
+}
+static inline vec3 div(const vec3 &a, float s) {
+  return {a.x / s, a.y / s, a.z / s};
+}
+static inline vec3 neg(const vec3 &a) { return {-a.x, -a.y, -a.z}; }
+
+static inline float dot(const vec3 &a, const vec3 &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+static inline vec3 cross(const vec3 &a, const vec3 &b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+          a.x * b.y - a.y * b.x};
+}
+static inline float length(const vec3 &a) { return std::sqrt(dot(a, a)); }
+static inline float distance(const vec3 &a, const vec3 &b) {
+  return length(sub(a, b));
+}
+static inline vec3 normalize(const vec3 &a) { return div(a, length(a)); }
+static inline float reduce_max(const vec3 &a) {
+  return std::max(a.x, std::max(a.y, a.z));
+}
+static inline float reduce_min(const vec3 &a) {
+  return std::min(a.x, std::min(a.y, a.z));
+}
+} // namespace scalar
+
+#ifdef VEC3_SSE2
+namespace sse { // same operation order as scalar:: -> same results
+static inline __m128 load(const vec3 &a) { return a.m; }
+static inline vec3 store(__m128 m) { return vec3(m); }
+#define VEC3_SHUFFLE(m, i, j, k) /* m.ijk, pad stays */                        \
+  _mm_shuffle_ps(m, m, _MM_SHUFFLE(3, k, j, i))
+
+static inline vec3 add(const vec3 &a, const vec3 &b) {
+  return store(_mm_add_ps(load(a), load(b)));
+}
+static inline vec3 sub(const vec3 &a, const vec3 &b) {
+  return store(_mm_sub_ps(load(a), load(b)));
+}
+static inline vec3 mul(const vec3 &a, const vec3 &b) {
+  return store(_mm_mul_ps(load(a), load(b)));
+}
+static inline vec3 mul(const vec3 &a, float s) { // pad * 0
+  return store(_mm_mul_ps(load(a), _mm_setr_ps(s, s, s, 0)));
+}
+static inline vec3 div(const vec3 &a, float s) { // pad / 1
+  return store(_mm_div_ps(load(a), _mm_setr_ps(s, s, s, 1)));
+}
+static inline vec3 neg(const vec3 &a) { // sign flip, -0 as scalar::neg
+  return store(_mm_xor_ps(load(a), _mm_setr_ps(-0.f, -0.f, -0.f, 0)));
+}
+
+static inline float hsum(__m128 m) { // (x + y) + z
+  return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, VEC3_SHUFFLE(m, 1, 1, 1)),
+                                  VEC3_SHUFFLE(m, 2, 2, 2)));
+}
+static inline float dot(const vec3 &a, const vec3 &b) {
+  return hsum(_mm_mul_ps(load(a), load(b)));
+}
+static inline vec3 cross(const vec3 &a, const vec3 &b) {
+  __m128 ma = load(a), mb = load(b);
+  __m128 l = _mm_mul_ps(VEC3_SHUFFLE(ma, 1, 2, 0), VEC3_SHUFFLE(mb, 2, 0, 1)),
+         r = _mm_mul_ps(VEC3_SHUFFLE(ma, 2, 0, 1), VEC3_SHUFFLE(mb, 1, 2, 0));
+  return store(_mm_sub_ps(l, r));
+}
+static inline float length(const vec3 &a) {
+  return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(dot(a, a))));
+}
+static inline float distance(const vec3 &a, const vec3 &b) {
+  __m128 d = _mm_sub_ps(load(a), load(b));
+  return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(hsum(_mm_mul_ps(d, d)))));
+}
+static inline vec3 normalize(const vec3 &a) { return div(a, length(a)); }
+static inline float reduce_max(const vec3 &a) { // std::max(p,q)=maxss(q,p)
+  __m128 m = load(a);
+  return _mm_cvtss_f32(_mm_max_ss(
+      _mm_max_ss(VEC3_SHUFFLE(m, 2, 2, 2), VEC3_SHUFFLE(m, 1, 1, 1)), m));
+}
+static inline float reduce_min(const vec3 &a) {
+  __m128 m = load(a);
+  return _mm_cvtss_f32(_mm_min_ss(
+      _mm_min_ss(VEC3_SHUFFLE(m, 2, 2, 2), VEC3_SHUFFLE(m, 1, 1, 1)), m));
+}
+#undef VEC3_SHUFFLE
+} // namespace sse
+using namespace sse;
+#else
+using namespace scalar;
+#endif
+
+} // namespace vec
+
+inline vec3 operator+(const vec3 &a, const vec3 &b) { return vec::add(a, b); }
+inline vec3 operator-(const vec3 &a, const vec3 &b) { return vec::sub(a, b); }
+inline vec3 operator-(const vec3 &a) { return vec::neg(a); }
+inline vec3 operator*(const vec3 &a, const vec3 &b) { return vec::mul(a, b); }
+inline vec3 operator*(const vec3 &a, float s) { return vec::mul(a, s); }
+inline vec3 operator*(float s, const vec3 &a) { return vec::mul(a, s); }
+inline vec3 operator/(const vec3 &a, float s) { return vec::div(a, s); }
+
+inline vec3 &vec3::operator+=(const vec3 &o) { return *this = *this + o; }
+inline vec3 &vec3::operator-=(const vec3 &o) { return *this = *this - o; }
+inline vec3 &vec3::operator*=(float s) { return *this = *this * s; }
+inline vec3 &vec3::operator/=(float s) { return *this = *this / s; }
+
+inline float3::float3(const vec3 &v) : x(v.x), y(v.y), z(v.z) {}
+inline float3 &float3::operator+=(const vec3 &o) { return *this = *this + o; }
+inline float3 &float3::operator-=(const vec3 &o) { return *this = *this - o; }
+inline float3 &float3::operator*=(float s) { return *this = *this * s; }
+inline float3 &float3::operator/=(float s) { return *this = *this / s; }
+
+#endif /* vec3_hpp */